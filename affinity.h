@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+// The CPU of the simulator thread and the CPU of the agent process,
+// including the threads reading its output.
+struct CorePair {
+    int simulator = -1;
+    int agent = -1;
+};
+
+// Parses a kernel style CPU list such as "0-3,8,10-11".
+inline std::vector<int> parseCpuList(const std::string &list) {
+    std::vector<int> cpus;
+    size_t pos = 0;
+    while (pos < list.size()) {
+        auto end = list.find(',', pos);
+        if (end == std::string::npos) {
+            end = list.size();
+        }
+        auto range = list.substr(pos, end - pos);
+        auto dash = range.find('-');
+        int first = std::stoi(range.substr(0, dash));
+        int last = dash == std::string::npos ? first
+                                             : std::stoi(range.substr(dash + 1));
+        for (int cpu = first; cpu <= last; cpu++) {
+            cpus.push_back(cpu);
+        }
+        pos = end + 1;
+    }
+    return cpus;
+}
+
+// Whether the calling thread may run on the CPU, without moving it there.
+inline bool isCpuAllowed(int cpu) {
+#ifdef __linux__
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+        return true;
+    }
+    return cpu >= 0 && cpu < CPU_SETSIZE && CPU_ISSET(cpu, &set);
+#else
+    return false;
+#endif
+}
+
+#ifdef __linux__
+inline std::string readFirstLine(const std::string &path) {
+    std::string line;
+    FILE *f = fopen(path.c_str(), "r");
+    if (f != nullptr) {
+        char buf[4096];
+        if (fgets(buf, sizeof(buf), f) != nullptr) {
+            line = buf;
+            while (!line.empty() && (line.back() == '\n' || line.back() == ' '))
+                line.pop_back();
+        }
+        fclose(f);
+    }
+    return line;
+}
+#endif
+
+// All pairs of usable CPUs that share a NUMA node, node by node. Both CPUs
+// of a pair are taken from the node's CPU list in order, which lists the
+// physical cores before their SMT siblings.
+inline std::vector<CorePair> listCorePairs() {
+    std::vector<CorePair> pairs;
+#ifdef __linux__
+    std::vector<std::vector<int>> nodes;
+    for (int node = 0;; node++) {
+        auto list = readFirstLine("/sys/devices/system/node/node" +
+                                  std::to_string(node) + "/cpulist");
+        if (list.empty()) {
+            break;
+        }
+        nodes.push_back(parseCpuList(list));
+    }
+    if (nodes.empty()) {
+        // No NUMA information, treat the machine as a single node.
+        nodes.push_back(
+            parseCpuList(readFirstLine("/sys/devices/system/cpu/online")));
+    }
+    for (auto &cpus : nodes) {
+        int pending = -1;
+        for (auto cpu : cpus) {
+            if (!isCpuAllowed(cpu)) {
+                continue;
+            }
+            if (pending < 0) {
+                pending = cpu;
+            } else {
+                pairs.push_back(CorePair{pending, cpu});
+                pending = -1;
+            }
+        }
+    }
+#endif
+    return pairs;
+}
+
+// Parses "<simulator>,<agent>" or "auto:<game index>". Games with different
+// indices get disjoint core pairs as long as there are enough of them.
+inline CorePair parseCorePair(const std::string &spec) {
+    if (spec.starts_with("auto:")) {
+        auto pairs = listCorePairs();
+        if (pairs.empty()) {
+            throw std::runtime_error("No core pair available for " + spec);
+        }
+        int index = std::stoi(spec.substr(5));
+        return pairs[index % pairs.size()];
+    }
+    auto comma = spec.find(',');
+    if (comma == std::string::npos) {
+        throw std::runtime_error("Invalid core pair " + spec);
+    }
+    return CorePair{std::stoi(spec.substr(0, comma)),
+                    std::stoi(spec.substr(comma + 1))};
+}
+
+// Pins the calling thread. Threads and processes it creates afterwards
+// inherit the affinity.
+inline bool pinCurrentThread(int cpu) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
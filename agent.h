@@ -0,0 +1,618 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+#include "enums.h"
+
+// The agent side of the protocol of CliController, for agent programs.
+// Header only; it needs nothing of the game but enums.h.
+//
+//     agent::Reader reader;
+//     agent::Writer writer;
+//     auto &level = reader.readLevel();
+//     agent::Frame frame;
+//     while (reader.nextFrame(frame)) {
+//         writer.begin(frame.frame);
+//         writer.move(1, 0);
+//         writer.putOrPick(0, -1);
+//         writer.send(level.spawns.size());
+//     }
+//
+// A frame is parsed in place: its strings are views into the buffer of
+// the reader, which stay valid until the next call of nextFrame. The
+// vectors of a frame keep their capacity, so once the buffers have grown
+// to the size of the game, reading and answering a frame does not
+// allocate.
+namespace agent {
+
+struct Recipe {
+    int time;
+    std::vector<std::string> ingredients;
+    std::vector<std::string> results;
+    // None for chopping.
+    ContainerKind containerKind;
+    TileKind tileKind;
+};
+
+struct IngredientBox {
+    int x, y;
+    std::string ingredient;
+    int price;
+};
+
+struct OrderTemplate {
+    int time, price, weight;
+    std::vector<std::string> ingredients;
+};
+
+struct Spawn {
+    float x, y;
+};
+
+// A pot, pan or plate on a tile when the game starts.
+struct Entity {
+    int x, y;
+    ContainerKind kind;
+};
+
+// The level file the game sends before the first frame.
+struct Level {
+    int width = 0, height = 0;
+    // Row by row; ingredient boxes are filled in from their list.
+    std::vector<TileKind> tiles;
+    std::vector<IngredientBox> boxes;
+    std::vector<Recipe> recipes;
+    int totalTime = 0, seed = 0;
+    std::vector<OrderTemplate> orderTemplates;
+    std::vector<Spawn> spawns;
+    std::vector<Entity> entities;
+
+    TileKind at(int x, int y) const { return tiles[y * width + x]; }
+};
+
+struct Container {
+    // None for a bare ingredient.
+    ContainerKind kind = ContainerKind::None;
+    bool overcooked = false;
+    bool collided = false;
+    int dirtyPlates = 0;
+    std::span<const std::string_view> ingredients;
+    // The ticks of the recipe in progress, or -1.
+    int progress = -1;
+    int progressMax = 0;
+
+    bool isWorking() const { return progress >= 0; }
+};
+
+struct Order {
+    int countdown;
+    int price;
+    std::span<const std::string_view> ingredients;
+};
+
+struct Player {
+    float x, y;
+    float vx, vy;
+    int respawnCountdown;
+    bool holding;
+    Container hand;
+};
+
+struct TileContainer {
+    int x, y;
+    Container container;
+};
+
+struct Frame {
+    int frame = 0;
+    // The time bank in milliseconds, or -1 without one.
+    int timeBank = -1;
+    int timeLeft = 0;
+    int fund = 0;
+    std::vector<Order> orders;
+    std::vector<Player> players;
+    std::vector<TileContainer> containers;
+    // The requests passed over to answer this one, because the agent ran
+    // behind.
+    int skipped = 0;
+
+    // The ingredients of all the orders and containers, which their spans
+    // point into.
+    std::vector<std::string_view> words;
+};
+
+// Reads the messages of the game, which end with a null byte, straight
+// from a file descriptor.
+class Reader {
+  public:
+    static constexpr size_t CHUNK = 1 << 16;
+
+    Reader(int fd = 0) : fd(fd) { buffer.resize(CHUNK); }
+
+    // Waits for the level. Must come first.
+    const Level &readLevel() {
+        if (!waitMessage()) {
+            throw std::runtime_error("No level from the game");
+        }
+        parseLevel(takeMessage());
+        return level;
+    }
+
+    // Waits for the next request. If more of them came in the meantime,
+    // the older ones are dropped, since the game has given up on them and
+    // only takes an answer to the newest. Returns false at the end of the
+    // game.
+    bool nextFrame(Frame &frame) {
+        if (!waitMessage()) {
+            return false;
+        }
+        // Whatever else is in the pipe already, without blocking.
+        while (isReadable() && fill()) {
+        }
+        int skipped = 0;
+        auto message = takeMessage();
+        while (hasMessage()) {
+            message = takeMessage();
+            skipped++;
+        }
+        parseFrame(message, frame);
+        frame.skipped = skipped;
+        return true;
+    }
+
+    const Level &getLevel() { return level; }
+
+  protected:
+    int fd;
+    std::vector<char> buffer;
+    // The bytes in [begin, end) are unread; the message before begin is
+    // the one the last frame points into.
+    size_t begin = 0, end = 0;
+    // Where to go on looking for the null byte of the next message.
+    size_t scanned = 0;
+    Level level;
+
+    // Reads what is available, at least one byte. False at the end of the
+    // input.
+    bool fill() {
+        if (begin > 0 && end == buffer.size()) {
+            // The last frame is done with, so its bytes can go.
+            std::memmove(buffer.data(), buffer.data() + begin, end - begin);
+            end -= begin;
+            scanned -= begin;
+            begin = 0;
+        }
+        if (end == buffer.size()) {
+            buffer.resize(buffer.size() * 2);
+        }
+        while (true) {
+#ifdef _WIN32
+            int n = _read(fd, buffer.data() + end,
+                          unsigned(buffer.size() - end));
+#else
+            ssize_t n = read(fd, buffer.data() + end, buffer.size() - end);
+#endif
+            if (n > 0) {
+                end += n;
+                return true;
+            }
+            if (n == 0 || errno != EINTR) {
+                return false;
+            }
+        }
+    }
+
+    bool isReadable() {
+#ifdef _WIN32
+        return false;
+#else
+        pollfd p{fd, POLLIN, 0};
+        return poll(&p, 1, 0) > 0 && (p.revents & POLLIN);
+#endif
+    }
+
+    bool hasMessage() {
+        auto found = std::memchr(buffer.data() + scanned, '\0', end - scanned);
+        if (found == nullptr) {
+            scanned = end;
+            return false;
+        }
+        scanned = static_cast<const char *>(found) - buffer.data();
+        return true;
+    }
+
+    bool waitMessage() {
+        if (begin > 0 && !hasMessage()) {
+            // Nothing of the last frame is needed any more; moving the
+            // partial message to the front keeps the buffer small.
+            std::memmove(buffer.data(), buffer.data() + begin, end - begin);
+            end -= begin;
+            scanned -= begin;
+            begin = 0;
+        }
+        while (!hasMessage()) {
+            if (!fill()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // The message up to the null byte found by hasMessage().
+    std::string_view takeMessage() {
+        std::string_view message(buffer.data() + begin, scanned - begin);
+        begin = scanned + 1;
+        scanned = begin;
+        return message;
+    }
+
+    // Tokens and lines
+
+    struct Cursor {
+        const char *p, *end;
+
+        void skipSpaces() {
+            while (p < end && (*p == ' ' || *p == '\r')) {
+                p++;
+            }
+        }
+        bool atLineEnd() {
+            skipSpaces();
+            return p == end || *p == '\n';
+        }
+        void nextLine() {
+            while (p < end && *p != '\n') {
+                p++;
+            }
+            if (p < end) {
+                p++;
+            }
+        }
+        // The next word of the line, or empty at its end.
+        std::string_view word() {
+            skipSpaces();
+            auto start = p;
+            while (p < end && *p != ' ' && *p != '\n' && *p != '\r') {
+                p++;
+            }
+            return std::string_view(start, p - start);
+        }
+        // The next word of the message, across lines.
+        std::string_view token() {
+            while (p < end && (*p == ' ' || *p == '\n' || *p == '\r')) {
+                p++;
+            }
+            return word();
+        }
+        template <typename T> T number() {
+            auto w = token();
+            T value{};
+            auto result = std::from_chars(w.data(), w.data() + w.size(), value);
+            if (result.ec != std::errc() || w.empty()) {
+                throw std::runtime_error("Expected a number, got \"" +
+                                         std::string(w) + "\"");
+            }
+            return value;
+        }
+    };
+
+    static ContainerKind getContainerKind(std::string_view word) {
+        if (word == "Pan") {
+            return ContainerKind::Pan;
+        } else if (word == "Pot") {
+            return ContainerKind::Pot;
+        } else if (word == "Plate") {
+            return ContainerKind::Plate;
+        } else if (word == "DirtyPlates") {
+            return ContainerKind::DirtyPlates;
+        }
+        throw std::runtime_error("Unknown container " + std::string(word));
+    }
+
+    // Where the ingredients of an order or container lie in the words of
+    // the frame. The spans are set from them once the words stop growing.
+    struct Range {
+        size_t first, count;
+    };
+    std::vector<Range> ranges;
+
+    // The ingredients up to the end of the line, or a ";", which is left
+    // in next.
+    static Range readIngredients(Cursor &in,
+                                 std::vector<std::string_view> &words,
+                                 std::string_view &next) {
+        size_t first = words.size();
+        for (next = in.word(); !next.empty() && next != ";";
+             next = in.word()) {
+            words.push_back(next);
+        }
+        return Range{first, words.size() - first};
+    }
+
+    // "[* ][@ ]Kind[ n][ : ingredients][ ; progress / max]", the rest of
+    // the line. A bare ingredient has no kind.
+    static Range readContainer(Cursor &in,
+                               std::vector<std::string_view> &words,
+                               Container &container) {
+        container = Container();
+        Range range{words.size(), 0};
+        auto word = in.word();
+        if (word == "*") {
+            container.overcooked = true;
+            word = in.word();
+        }
+        if (word == "@") {
+            container.collided = true;
+            word = in.word();
+        }
+        if (word != ":") {
+            container.kind = getContainerKind(word);
+            if (container.kind == ContainerKind::DirtyPlates) {
+                container.dirtyPlates = in.number<int>();
+            }
+            word = in.word();
+        }
+        if (word == ":") {
+            range = readIngredients(in, words, word);
+        }
+        if (word == ";") {
+            container.progress = in.number<int>();
+            in.word();
+            container.progressMax = in.number<int>();
+        }
+        return range;
+    }
+
+    void parseFrame(std::string_view message, Frame &frame) {
+        Cursor in{message.data(), message.data() + message.size()};
+        auto &words = frame.words;
+        words.clear();
+        ranges.clear();
+
+        if (in.token() != "Frame") {
+            throw std::runtime_error("Expected a frame");
+        }
+        frame.frame = in.number<int>();
+        frame.timeBank = in.atLineEnd() ? -1 : in.number<int>();
+        frame.timeLeft = in.number<int>();
+        frame.fund = in.number<int>();
+
+        int orderCount = in.number<int>();
+        frame.orders.clear();
+        for (int i = 0; i < orderCount; i++) {
+            Order order;
+            order.countdown = in.number<int>();
+            order.price = in.number<int>();
+            std::string_view next;
+            ranges.push_back(readIngredients(in, words, next));
+            frame.orders.push_back(order);
+        }
+
+        int playerCount = in.number<int>();
+        frame.players.clear();
+        for (int i = 0; i < playerCount; i++) {
+            Player player;
+            player.x = in.number<float>();
+            player.y = in.number<float>();
+            player.vx = in.number<float>();
+            player.vy = in.number<float>();
+            player.respawnCountdown = in.number<int>();
+            player.holding = !in.atLineEnd();
+            player.hand = Container();
+            Range range{words.size(), 0};
+            if (player.holding) {
+                // The ";" before the container.
+                in.word();
+                range = readContainer(in, words, player.hand);
+            }
+            ranges.push_back(range);
+            frame.players.push_back(player);
+        }
+
+        int containerCount = in.number<int>();
+        frame.containers.clear();
+        for (int i = 0; i < containerCount; i++) {
+            TileContainer tile;
+            tile.x = in.number<int>();
+            tile.y = in.number<int>();
+            ranges.push_back(readContainer(in, words, tile.container));
+            frame.containers.push_back(tile);
+        }
+
+        auto range = ranges.begin();
+        auto bind = [&](std::span<const std::string_view> &span) {
+            span = std::span<const std::string_view>(
+                words.data() + range->first, range->count);
+            range++;
+        };
+        for (auto &order : frame.orders) {
+            bind(order.ingredients);
+        }
+        for (auto &player : frame.players) {
+            bind(player.hand.ingredients);
+        }
+        for (auto &tile : frame.containers) {
+            bind(tile.container.ingredients);
+        }
+    }
+
+    void parseLevel(std::string_view message) {
+        Cursor in{message.data(), message.data() + message.size()};
+        level = Level();
+        level.width = in.number<int>();
+        level.height = in.number<int>();
+        level.tiles.assign(level.width * level.height, TileKind::None);
+        for (int y = 0; y < level.height; y++) {
+            auto row = in.token();
+            if (int(row.size()) < level.width) {
+                throw std::runtime_error("Short row in the level");
+            }
+            for (int x = 0; x < level.width; x++) {
+                // Letters are filled in by the illustrations.
+                if (row[x] < 'A' || row[x] > 'Z') {
+                    level.tiles[y * level.width + x] = getTileKind(row[x]);
+                }
+            }
+        }
+
+        int illustrationCount = in.number<int>();
+        for (int i = 0; i < illustrationCount; i++) {
+            if (in.token() != "IngredientBox") {
+                throw std::runtime_error("Invalid illustration");
+            }
+            IngredientBox box;
+            box.x = in.number<int>();
+            box.y = in.number<int>();
+            box.ingredient = in.token();
+            box.price = in.number<int>();
+            level.tiles[box.y * level.width + box.x] = TileKind::IngredientBox;
+            level.boxes.push_back(std::move(box));
+        }
+
+        int recipeCount = in.number<int>();
+        for (int i = 0; i < recipeCount; i++) {
+            Recipe recipe;
+            recipe.time = in.number<int>();
+            auto word = in.token();
+            for (; !word.starts_with("-"); word = in.word()) {
+                recipe.ingredients.emplace_back(word);
+            }
+            if (word == "-chop->") {
+                recipe.containerKind = ContainerKind::None;
+                recipe.tileKind = TileKind::ChoppingStation;
+            } else if (word == "-pot->") {
+                recipe.containerKind = ContainerKind::Pot;
+                recipe.tileKind = TileKind::Stove;
+            } else if (word == "-pan->") {
+                recipe.containerKind = ContainerKind::Pan;
+                recipe.tileKind = TileKind::Stove;
+            } else {
+                throw std::runtime_error("Invalid recipe");
+            }
+            for (word = in.word(); !word.empty(); word = in.word()) {
+                recipe.results.emplace_back(word);
+            }
+            level.recipes.push_back(std::move(recipe));
+        }
+
+        level.totalTime = in.number<int>();
+        level.seed = in.number<int>();
+        int templateCount = in.number<int>();
+        for (int i = 0; i < templateCount; i++) {
+            OrderTemplate order;
+            order.time = in.number<int>();
+            order.price = in.number<int>();
+            order.weight = in.number<int>();
+            for (auto word = in.word(); !word.empty(); word = in.word()) {
+                order.ingredients.emplace_back(word);
+            }
+            level.orderTemplates.push_back(std::move(order));
+        }
+
+        int playerCount = in.number<int>();
+        for (int i = 0; i < playerCount; i++) {
+            Spawn spawn;
+            spawn.x = in.number<float>();
+            spawn.y = in.number<float>();
+            level.spawns.push_back(spawn);
+        }
+
+        int entityCount = in.number<int>();
+        for (int i = 0; i < entityCount; i++) {
+            Entity entity;
+            entity.x = in.number<int>();
+            entity.y = in.number<int>();
+            entity.kind = getContainerKind(in.token());
+            level.entities.push_back(entity);
+        }
+    }
+};
+
+// Collects the actions of a frame, one per player in seat order, and
+// sends them with a single write.
+class Writer {
+  public:
+    Writer(int fd = 1) : fd(fd) {}
+
+    void begin(int frame) {
+        out.clear();
+        out += "Frame ";
+        appendInt(frame);
+        out += '\n';
+        actions = 0;
+    }
+
+    // Directions are -1, 0 or 1 on each axis, with y pointing down.
+    void move(int dx, int dy) { add("Move", dx, dy); }
+    void interact(int dx, int dy) { add("Interact", dx, dy); }
+    void putOrPick(int dx, int dy) { add("PutOrPick", dx, dy); }
+
+    // The players without an action stand still.
+    void send(int playerCount) {
+        for (; actions < playerCount; actions++) {
+            out += "Move\n";
+        }
+        size_t done = 0;
+        while (done < out.size()) {
+#ifdef _WIN32
+            int n = _write(fd, out.data() + done, unsigned(out.size() - done));
+#else
+            ssize_t n = write(fd, out.data() + done, out.size() - done);
+#endif
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::runtime_error("Cannot write the actions");
+            }
+            done += n;
+        }
+    }
+
+  protected:
+    int fd;
+    std::string out;
+    int actions = 0;
+
+    void appendInt(int value) {
+        char text[16];
+        auto result = std::to_chars(text, text + sizeof(text), value);
+        out.append(text, result.ptr);
+    }
+
+    void add(const char *kind, int dx, int dy) {
+        out += kind;
+        if (dx != 0 || dy != 0) {
+            out += ' ';
+            if (dx < 0) {
+                out += 'L';
+            } else if (dx > 0) {
+                out += 'R';
+            }
+            if (dy < 0) {
+                out += 'U';
+            } else if (dy > 0) {
+                out += 'D';
+            }
+        }
+        out += '\n';
+        actions++;
+    }
+};
+
+} // namespace agent
@@ -0,0 +1,1390 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "controller.h"
+#include "gamemanager.h"
+
+// Plays the seats from firstSeat on inside the simulator. It is the
+// baseline that agents are measured against and fills the seats that
+// nobody plays; it plays reasonably, not well.
+//
+// Dishes are built on plates lying on tables. The bot takes the orders in
+// turn, and every missing ingredient of a dish becomes a task of a few
+// steps over the recipes of the level, such as fetching fish, chopping it
+// and putting it on the plate. Pots are filled and left on the stove while
+// the player does other work, and collected once they are done. Players
+// walk along distance fields on the floor grid, which are built the first
+// time a tile is headed for and kept, so a frame only looks at the
+// containers and the players.
+class BotController : public Controller {
+  public:
+    BotController(GameManager *gameManager, int firstSeat = 0)
+        : Controller(gameManager), firstSeat(firstSeat) {}
+
+    // The level is taken from the game, which must have it loaded.
+    void init(const char *levelFile) override {
+        width = gameManager->getWidth();
+        height = gameManager->getHeight();
+        tiles = gameManager->getTiles();
+        fields.assign(tiles.size(), {});
+        reserved.assign(tiles.size(), false);
+        containerTiles.clear();
+        for (auto tile : gameManager->getContainerTiles()) {
+            containerTiles.push_back(tileIndex(tile));
+        }
+        tilesOfKind.assign(KIND_COUNT, {});
+        for (int i = 0; i < tiles.size(); i++) {
+            if (tiles[i] != nullptr) {
+                tilesOfKind[int(tiles[i]->getTileKind())].push_back(i);
+            }
+        }
+
+        sources.clear();
+        for (int i : tilesOfKind[int(TileKind::IngredientBox)]) {
+            auto box = static_cast<TileIngredientBox *>(tiles[i]);
+            sources[box->getIngredient()].boxes.push_back(i);
+        }
+        for (auto &recipe : gameManager->getRecipes()) {
+            for (auto &result : recipe.result.getIngredients()) {
+                auto &source = sources[result];
+                if (source.boxes.empty() && source.recipe == nullptr) {
+                    source.recipe = &recipe;
+                }
+            }
+        }
+        feasible.clear();
+        labelComponents();
+
+        bots.clear();
+        dishes.clear();
+        for (int i = firstSeat; i < gameManager->getPlayers().size(); i++) {
+            bots.emplace_back(i);
+        }
+        decisions.assign(gameManager->getPlayers().size(), "Move");
+    }
+
+    std::vector<std::string> requestInputs() override {
+        decide();
+        std::vector<std::string> res(decisions.size(), "Move");
+        fillInputs(res);
+        return res;
+    }
+
+    // Decides the inputs of the seats of the bot in the current state.
+    void decide() {
+        auto start = std::chrono::steady_clock::now();
+        updateDishes();
+        for (auto &bot : bots) {
+            play(bot, decisions[bot.seat]);
+        }
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        frames++;
+        totalTime += elapsed;
+        maxTime = std::max(maxTime, elapsed);
+    }
+
+    // Overwrites the inputs of the seats of the bot with its last decision.
+    void fillInputs(std::vector<std::string> &inputs) {
+        for (auto &bot : bots) {
+            inputs[bot.seat] = decisions[bot.seat];
+        }
+    }
+
+    int getFirstSeat() { return firstSeat; }
+
+    void printReport(std::ostream &os) {
+        auto ms = [](std::chrono::steady_clock::duration t) {
+            return std::chrono::duration<double, std::milli>(t).count();
+        };
+        os << "Bot time: mean " << ms(totalTime) / std::max(frames, 1)
+           << "ms, max " << ms(maxTime) << "ms over " << frames
+           << " frames\n";
+    }
+
+  protected:
+    static constexpr uint16_t UNREACHABLE = 0xffff;
+    static constexpr int KIND_COUNT = int(TileKind::PlateRack) + 1;
+    // A bit less than the players brake with, so that they stop short
+    // rather than overshoot.
+    static constexpr float BRAKING = 20.0f;
+    static constexpr float ARRIVE_DISTANCE = 0.2f;
+    static constexpr float ARRIVE_SPEED = 1.0f;
+    // Interactions stop when the player drifts away, so it has to stand.
+    static constexpr float STAND_SPEED = 0.3f;
+    static constexpr int STEP_TIMEOUT = 30 * FPS;
+    static constexpr int MAX_ATTEMPTS = 5;
+    static constexpr int REINTERACT_FRAMES = FPS / 2;
+    static constexpr int STUCK_FRAMES = 45;
+    static constexpr int DETOUR_FRAMES = FPS;
+    static constexpr int MAX_DETOURS = 2;
+    // How long a bot that gave up on a jam keeps out of the way, times its
+    // index.
+    static constexpr int BACKOFF_FRAMES = FPS;
+    // A rough cost of one ingredient of an order that needs no stove.
+    static constexpr int INGREDIENT_FRAMES = 4 * FPS;
+
+    enum class StepKind {
+        PickUp,
+        PutDown,
+        // Put the content of the container in hand somewhere, keeping it.
+        Pour,
+        Chop,
+        Wash,
+    };
+    // What the target tile must hold for the step to make sense.
+    enum class Need { Any, Empty, Occupied };
+    struct Step {
+        StepKind kind;
+        int tile;
+        Need need = Need::Any;
+        // The result of chopping.
+        const Recipe *recipe = nullptr;
+    };
+
+    enum class TaskKind { Deliver, Cook, Collect, Serve, Clean, Wash, Stash };
+    struct Task {
+        TaskKind kind = TaskKind::Stash;
+        std::vector<Step> steps;
+        int current = 0;
+        int dish = -1;
+        // The ingredients this task will bring to the dish.
+        std::vector<std::string> promised;
+        std::vector<int> reserved;
+        int stove = -1;
+        const Recipe *recipe = nullptr;
+    };
+
+    struct Cooking {
+        int stove;
+        const Recipe *recipe;
+        bool collecting = false;
+    };
+    struct Dish {
+        Dish(int id, std::vector<std::string> target, int plate)
+            : id(id), target(std::move(target)), plate(plate) {}
+
+        int id;
+        std::vector<std::string> target;
+        int plate;
+        std::vector<Cooking> cooking;
+        bool serving = false;
+    };
+
+    struct Bot {
+        explicit Bot(int seat) : seat(seat) {}
+
+        int seat;
+        std::optional<Task> task;
+        int stepFrames = 0;
+        int attempts = 0;
+        int interactCooldown = 0;
+        uint16_t bestDistance = UNREACHABLE;
+        int stuckFrames = 0;
+        int detours = 0;
+        int detourFrames = 0;
+        int detourTile = -1;
+        std::vector<uint16_t> detour;
+        int backoff = 0;
+    };
+
+    struct Source {
+        std::vector<int> boxes;
+        const Recipe *recipe = nullptr;
+    };
+
+    int firstSeat;
+    int width = 0;
+    int height = 0;
+    std::vector<Tile *> tiles;
+    std::vector<int> containerTiles;
+    std::vector<std::vector<int>> tilesOfKind;
+    // The distance from every floor cell to a cell next to the tile, built
+    // on demand.
+    std::vector<std::vector<uint16_t>> fields;
+    // The connected parts of the floor, -1 elsewhere.
+    std::vector<int> components;
+    std::vector<bool> reserved;
+    std::unordered_map<std::string, Source> sources;
+    std::unordered_map<std::string, bool> feasible;
+
+    std::vector<Bot> bots;
+    std::vector<Dish> dishes;
+    int nextDishId = 0;
+    std::vector<std::string> decisions;
+    // The floor part of the bot being planned for.
+    int component = -1;
+    std::vector<int> queue;
+
+    int frames = 0;
+    std::chrono::steady_clock::duration totalTime{0};
+    std::chrono::steady_clock::duration maxTime{0};
+
+    int tileIndex(Tile *tile) {
+        return int(tile->getPos().x) + int(tile->getPos().y) * width;
+    }
+    TileKind kindAt(int tile) {
+        return tiles[tile] == nullptr ? TileKind::None
+                                      : tiles[tile]->getTileKind();
+    }
+    bool isFloor(int cell) { return kindAt(cell) == TileKind::Floor; }
+    ContainerHolder *containerAt(int tile) {
+        return tiles[tile] == nullptr ? nullptr : tiles[tile]->getContainer();
+    }
+    const std::vector<std::string> &mixtureAt(int tile) {
+        static const std::vector<std::string> empty;
+        auto container = containerAt(tile);
+        if (container == nullptr || container->isNull()) {
+            return empty;
+        }
+        return container->getMixture().getIngredients();
+    }
+    ContainerKind containerKindAt(int tile) {
+        auto container = containerAt(tile);
+        return container == nullptr ? ContainerKind::None
+                                    : container->getContainerKind();
+    }
+    bool isFree(int tile) {
+        auto container = containerAt(tile);
+        return container != nullptr && container->isNull() && !reserved[tile];
+    }
+    int cellOf(Player *player) {
+        auto pos = player->getPosition();
+        int x = std::floor(pos.x);
+        int y = std::floor(pos.y);
+        if (x < 0 || x >= width || y < 0 || y >= height) {
+            return -1;
+        }
+        return x + y * width;
+    }
+    int manhattan(int a, int b) {
+        return std::abs(a % width - b % width) +
+               std::abs(a / width - b / width);
+    }
+
+    // The orthogonal neighbour in direction k, or -1 outside of the map.
+    int neighbour(int cell, int k) {
+        static constexpr int DX[] = {1, -1, 0, 0};
+        static constexpr int DY[] = {0, 0, 1, -1};
+        int x = cell % width + DX[k];
+        int y = cell / width + DY[k];
+        if (x < 0 || x >= width || y < 0 || y >= height) {
+            return -1;
+        }
+        return x + y * width;
+    }
+
+    void labelComponents() {
+        components.assign(tiles.size(), -1);
+        int count = 0;
+        for (int i = 0; i < tiles.size(); i++) {
+            if (!isFloor(i) || components[i] >= 0) {
+                continue;
+            }
+            queue.assign(1, i);
+            components[i] = count;
+            for (int head = 0; head < queue.size(); head++) {
+                for (int k = 0; k < 4; k++) {
+                    int next = neighbour(queue[head], k);
+                    if (next >= 0 && isFloor(next) && components[next] < 0) {
+                        components[next] = count;
+                        queue.push_back(next);
+                    }
+                }
+            }
+            count++;
+        }
+    }
+
+    // Whether the bot being planned for can stand next to the tile.
+    bool reachable(int tile) {
+        for (int k = 0; k < 4; k++) {
+            int cell = neighbour(tile, k);
+            if (cell >= 0 && components[cell] == component) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Breadth-first from the floor cells next to the tile, around the
+    // blocked cells.
+    void buildField(int tile, std::vector<uint16_t> &field,
+                    const std::vector<int> &blocked) {
+        field.assign(tiles.size(), UNREACHABLE);
+        queue.clear();
+        auto isOpen = [&](int cell) {
+            return cell >= 0 && isFloor(cell) && field[cell] == UNREACHABLE &&
+                   std::find(blocked.begin(), blocked.end(), cell) ==
+                       blocked.end();
+        };
+        for (int k = 0; k < 4; k++) {
+            int cell = neighbour(tile, k);
+            if (isOpen(cell)) {
+                field[cell] = 0;
+                queue.push_back(cell);
+            }
+        }
+        for (int head = 0; head < queue.size(); head++) {
+            int cell = queue[head];
+            for (int k = 0; k < 4; k++) {
+                int next = neighbour(cell, k);
+                if (isOpen(next)) {
+                    field[next] = field[cell] + 1;
+                    queue.push_back(next);
+                }
+            }
+        }
+    }
+
+    const std::vector<uint16_t> &getField(int tile) {
+        if (fields[tile].empty()) {
+            buildField(tile, fields[tile], {});
+        }
+        return fields[tile];
+    }
+
+    // The nearest tile of the kind that the bot can reach, by Manhattan
+    // distance from the cell. Only free tiles if asked.
+    int nearest(TileKind kind, int cell, bool free) {
+        int best = -1;
+        for (int tile : tilesOfKind[int(kind)]) {
+            if ((free && !isFree(tile)) || !reachable(tile)) {
+                continue;
+            }
+            if (best < 0 || manhattan(tile, cell) < manhattan(best, cell)) {
+                best = tile;
+            }
+        }
+        return best;
+    }
+
+    static bool includes(const std::vector<std::string> &a,
+                         const std::vector<std::string> &b) {
+        return std::includes(a.begin(), a.end(), b.begin(), b.end());
+    }
+    // The multiset a - b of sorted lists.
+    static std::vector<std::string>
+    subtract(const std::vector<std::string> &a,
+             const std::vector<std::string> &b) {
+        std::vector<std::string> res;
+        std::set_difference(a.begin(), a.end(), b.begin(), b.end(),
+                            std::back_inserter(res));
+        return res;
+    }
+
+    // Planning
+
+    Dish *findDish(int id) {
+        for (auto &dish : dishes) {
+            if (dish.id == id) {
+                return &dish;
+            }
+        }
+        return nullptr;
+    }
+    void eraseDish(int id) {
+        std::erase_if(dishes, [&](Dish &dish) { return dish.id == id; });
+    }
+
+    bool isCooking(int tile, const Recipe *recipe) {
+        auto container = containerAt(tile);
+        if (container == nullptr || container->isNull() ||
+            container->getContainerKind() != recipe->containerKind) {
+            return false;
+        }
+        auto &mixture = container->getMixture();
+        return mixture == recipe->ingredients || mixture == recipe->result;
+    }
+    bool isReady(int tile) {
+        auto container = containerAt(tile);
+        return container != nullptr && container->isWorking() &&
+               container->getProgress() >= 1;
+    }
+    bool inCooking(int tile) {
+        for (auto &dish : dishes) {
+            for (auto &cooking : dish.cooking) {
+                if (cooking.stove == tile) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+    bool hasOrder(const std::vector<std::string> &target) {
+        for (auto &order : gameManager->getOrders()) {
+            if (order.mixture.getIngredients() == target) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Drop the dishes whose plate is gone or whose order is, and forget the
+    // pots whose content was changed behind the back of the bot.
+    void updateDishes() {
+        std::erase_if(dishes, [&](Dish &dish) {
+            if (dish.serving) {
+                return false;
+            }
+            if ((containerKindAt(dish.plate) != ContainerKind::Plate &&
+                 !reserved[dish.plate]) ||
+                !hasOrder(dish.target)) {
+                return true;
+            }
+            std::erase_if(dish.cooking, [&](Cooking &cooking) {
+                return !cooking.collecting &&
+                       !isCooking(cooking.stove, cooking.recipe);
+            });
+            return false;
+        });
+    }
+
+    // The ingredients of the dish that nobody is seeing to yet.
+    std::vector<std::string> getMissing(Dish &dish) {
+        std::vector<std::string> promised;
+        for (auto &bot : bots) {
+            if (bot.task.has_value() && bot.task->dish == dish.id) {
+                promised.insert(promised.end(), bot.task->promised.begin(),
+                                bot.task->promised.end());
+            }
+        }
+        for (auto &cooking : dish.cooking) {
+            auto &result = cooking.recipe->result.getIngredients();
+            promised.insert(promised.end(), result.begin(), result.end());
+        }
+        std::sort(promised.begin(), promised.end());
+        return subtract(subtract(dish.target, mixtureAt(dish.plate)),
+                        promised);
+    }
+
+    // Whether an ingredient can be brought in hand: taken from a box or
+    // chopped from one that can.
+    bool canHold(const std::string &ingredient, int depth = 0) {
+        auto it = sources.find(ingredient);
+        if (it == sources.end() || depth > 4) {
+            return false;
+        }
+        if (!it->second.boxes.empty()) {
+            return true;
+        }
+        auto recipe = it->second.recipe;
+        return recipe->tileKind == TileKind::ChoppingStation &&
+               recipe->ingredients.getIngredients().size() == 1 &&
+               !tilesOfKind[int(TileKind::ChoppingStation)].empty() &&
+               canHold(recipe->ingredients.getIngredients()[0], depth + 1);
+    }
+
+    bool isFeasible(const std::vector<std::string> &target) {
+        std::string key;
+        for (auto &ingredient : target) {
+            key += ingredient;
+            key += ' ';
+        }
+        auto it = feasible.find(key);
+        if (it != feasible.end()) {
+            return it->second;
+        }
+        bool res = !target.empty();
+        for (auto &ingredient : target) {
+            auto source = sources.find(ingredient);
+            if (source == sources.end()) {
+                res = false;
+                break;
+            }
+            auto recipe = source->second.recipe;
+            if (recipe == nullptr || recipe->tileKind != TileKind::Stove) {
+                res = res && canHold(ingredient);
+                continue;
+            }
+            bool hasContainer = false;
+            for (int tile : containerTiles) {
+                hasContainer |=
+                    containerKindAt(tile) == recipe->containerKind;
+            }
+            res = res && hasContainer &&
+                  !tilesOfKind[int(TileKind::Stove)].empty() &&
+                  includes(target, recipe->result.getIngredients());
+            for (auto &input : recipe->ingredients.getIngredients()) {
+                res = res && canHold(input);
+            }
+        }
+        feasible[key] = res;
+        return res;
+    }
+
+    // A rough guess of the frames an order takes.
+    int estimate(const std::vector<std::string> &target) {
+        int cooking = 0;
+        for (auto &ingredient : target) {
+            auto recipe = sources[ingredient].recipe;
+            if (recipe != nullptr && recipe->tileKind == TileKind::Stove) {
+                cooking = std::max(cooking, recipe->time);
+            }
+        }
+        return cooking + INGREDIENT_FRAMES * target.size();
+    }
+
+    void reserve(Task &task, int tile) {
+        reserved[tile] = true;
+        task.reserved.push_back(tile);
+    }
+    void release(Task &task) {
+        for (int tile : task.reserved) {
+            reserved[tile] = false;
+        }
+        task.reserved.clear();
+    }
+    bool fail(Task &task) {
+        release(task);
+        task = Task();
+        return false;
+    }
+
+    bool assign(Bot &bot, Player *player) {
+        int cell = cellOf(player);
+        if (cell < 0) {
+            return false;
+        }
+        component = components[cell];
+        Task task;
+        if (!player->getOnHand()->isNull()) {
+            if (!planStash(player, cell, task)) {
+                return false;
+            }
+        } else if (!planCollect(task) && !planServe(cell, task) &&
+                   !planClean(cell, task) &&
+                   !(needsPlates() && planWash(cell, task)) &&
+                   !planDishes(cell, task) && !planWash(cell, task)) {
+            return false;
+        }
+        bot.task = std::move(task);
+        startStep(bot);
+        return true;
+    }
+
+    // Put away what the player holds without a task.
+    bool planStash(Player *player, int cell, Task &task) {
+        auto hand = player->getOnHand();
+        int target = -1;
+        Need need = Need::Empty;
+        switch (hand->getContainerKind()) {
+        case ContainerKind::None:
+            target = nearest(TileKind::Trashbin, cell, false);
+            need = Need::Any;
+            break;
+        case ContainerKind::Pan:
+        case ContainerKind::Pot:
+            target = nearest(TileKind::Stove, cell, true);
+            break;
+        case ContainerKind::DirtyPlates:
+            target = nearest(TileKind::Sink, cell, false);
+            need = Need::Any;
+            break;
+        case ContainerKind::Plate:
+            break;
+        }
+        if (target < 0) {
+            target = nearest(TileKind::Table, cell, true);
+            need = Need::Empty;
+        }
+        if (target < 0) {
+            return false;
+        }
+        task.kind = TaskKind::Stash;
+        task.steps.push_back(Step{StepKind::PutDown, target, need});
+        if (need == Need::Empty) {
+            reserve(task, target);
+        }
+        return true;
+    }
+
+    // Take a finished pot to its dish before it burns.
+    bool planCollect(Task &task) {
+        for (auto &dish : dishes) {
+            if (dish.serving || !reachable(dish.plate)) {
+                continue;
+            }
+            for (auto &cooking : dish.cooking) {
+                if (cooking.collecting || reserved[cooking.stove] ||
+                    !reachable(cooking.stove) || !isReady(cooking.stove)) {
+                    continue;
+                }
+                cooking.collecting = true;
+                task.kind = TaskKind::Collect;
+                task.dish = dish.id;
+                task.stove = cooking.stove;
+                task.steps = {
+                    Step{StepKind::PickUp, cooking.stove, Need::Occupied},
+                    Step{StepKind::Pour, dish.plate, Need::Occupied},
+                    Step{StepKind::PutDown, cooking.stove, Need::Empty},
+                };
+                reserve(task, cooking.stove);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool planServe(int cell, Task &task) {
+        for (auto &dish : dishes) {
+            if (dish.serving || !dish.cooking.empty() ||
+                mixtureAt(dish.plate) != dish.target ||
+                reserved[dish.plate] || !reachable(dish.plate)) {
+                continue;
+            }
+            bool busy = false;
+            for (auto &bot : bots) {
+                busy |= bot.task.has_value() && bot.task->dish == dish.id;
+            }
+            int window = nearest(TileKind::ServiceWindow, dish.plate, false);
+            if (busy || window < 0) {
+                continue;
+            }
+            dish.serving = true;
+            task.kind = TaskKind::Serve;
+            task.dish = dish.id;
+            task.steps = {
+                Step{StepKind::PickUp, dish.plate, Need::Occupied},
+                Step{StepKind::PutDown, window},
+            };
+            reserve(task, dish.plate);
+            return true;
+        }
+        return false;
+    }
+
+    bool matchesRecipe(ContainerHolder *container) {
+        for (auto &recipe : gameManager->getRecipes()) {
+            if (container->getContainerKind() == recipe.containerKind &&
+                (container->getMixture() == recipe.ingredients ||
+                 container->getMixture() == recipe.result)) {
+                return true;
+            }
+        }
+        return false;
+    }
+    bool fitsOrder(const std::vector<std::string> &mixture) {
+        for (auto &order : gameManager->getOrders()) {
+            if (includes(order.mixture.getIngredients(), mixture)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Whether what lies on the tile is of no use to any dish.
+    bool isGarbage(int tile) {
+        auto container = containerAt(tile);
+        if (container->isNull() || container->isEmpty()) {
+            return false;
+        }
+        if (kindAt(tile) == TileKind::ChoppingStation) {
+            return true;
+        }
+        switch (container->getContainerKind()) {
+        case ContainerKind::Pan:
+        case ContainerKind::Pot:
+            return !inCooking(tile) &&
+                   (container->isOvercooked() || !matchesRecipe(container));
+        case ContainerKind::Plate:
+            for (auto &dish : dishes) {
+                if (dish.plate == tile) {
+                    return !includes(dish.target, mixtureAt(tile));
+                }
+            }
+            return !fitsOrder(mixtureAt(tile));
+        default:
+            return false;
+        }
+    }
+
+    // Throw away what is in the way, keeping the containers where they
+    // are.
+    bool planClean(int cell, Task &task) {
+        int trash = nearest(TileKind::Trashbin, cell, false);
+        if (trash < 0) {
+            return false;
+        }
+        for (int tile : containerTiles) {
+            if (reserved[tile] || !reachable(tile) || !isGarbage(tile)) {
+                continue;
+            }
+            task.kind = TaskKind::Clean;
+            task.steps.push_back(Step{StepKind::PickUp, tile, Need::Occupied});
+            if (containerKindAt(tile) == ContainerKind::None) {
+                task.steps.push_back(Step{StepKind::PutDown, trash});
+            } else {
+                task.steps.push_back(Step{StepKind::Pour, trash});
+                task.steps.push_back(
+                    Step{StepKind::PutDown, tile, Need::Empty});
+            }
+            reserve(task, tile);
+            return true;
+        }
+        return false;
+    }
+
+    bool isDishPlate(int tile) {
+        for (auto &dish : dishes) {
+            if (dish.plate == tile) {
+                return true;
+            }
+        }
+        return false;
+    }
+    bool isPlateSpot(int tile) {
+        auto kind = kindAt(tile);
+        return kind != TileKind::Stove && kind != TileKind::ChoppingStation;
+    }
+
+    bool needsPlates() {
+        if (!dishes.empty()) {
+            return false;
+        }
+        for (int tile : containerTiles) {
+            if (containerKindAt(tile) == ContainerKind::Plate &&
+                !reserved[tile] && isPlateSpot(tile)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool planWash(int cell, Task &task) {
+        int sink = nearest(TileKind::Sink, cell, false);
+        if (sink < 0 || reserved[sink]) {
+            return false;
+        }
+        task.kind = TaskKind::Wash;
+        if (containerKindAt(sink) != ContainerKind::DirtyPlates) {
+            if (!containerAt(sink)->isNull()) {
+                return false;
+            }
+            int dirty = -1;
+            for (int tile : containerTiles) {
+                if (tile != sink && !reserved[tile] && reachable(tile) &&
+                    containerKindAt(tile) == ContainerKind::DirtyPlates) {
+                    dirty = tile;
+                    break;
+                }
+            }
+            if (dirty < 0) {
+                return false;
+            }
+            task.steps.push_back(Step{StepKind::PickUp, dirty, Need::Occupied});
+            task.steps.push_back(Step{StepKind::PutDown, sink, Need::Empty});
+            reserve(task, dirty);
+        }
+        task.steps.push_back(Step{StepKind::Wash, sink});
+        reserve(task, sink);
+        return true;
+    }
+
+    // Work on the dishes in the order they were started, and start another
+    // one when they are all seen to.
+    bool planDishes(int cell, Task &task) {
+        for (auto &dish : dishes) {
+            if (!dish.serving && reachable(dish.plate) &&
+                planIngredient(dish, cell, task)) {
+                return true;
+            }
+        }
+        if (dishes.size() <= bots.size() && startDish()) {
+            return planIngredient(dishes.back(), cell, task);
+        }
+        return false;
+    }
+
+    // Pick the most urgent order that no dish is for yet and a plate for
+    // it, preferring one that already holds part of the order.
+    bool startDish() {
+        auto &orders = gameManager->getOrders();
+        std::vector<int> byDeadline(orders.size());
+        for (int i = 0; i < orders.size(); i++) {
+            byDeadline[i] = i;
+        }
+        std::sort(byDeadline.begin(), byDeadline.end(), [&](int a, int b) {
+            return orders[a].deadline < orders[b].deadline;
+        });
+        int best = -1;
+        int fallback = -1;
+        for (int n = 0; n < byDeadline.size(); n++) {
+            auto &order = orders[byDeadline[n]];
+            auto &target = order.mixture.getIngredients();
+            int covered = 0;
+            for (auto &dish : dishes) {
+                covered += dish.target == target;
+            }
+            for (int m = 0; m < n; m++) {
+                covered -= orders[byDeadline[m]].mixture == order.mixture;
+            }
+            if (covered > 0 || !isFeasible(target)) {
+                continue;
+            }
+            int countdown = gameManager->orderManager.getCountdown(order);
+            if (countdown >= estimate(target)) {
+                best = byDeadline[n];
+                break;
+            }
+            if (fallback < 0 ||
+                countdown > gameManager->orderManager.getCountdown(
+                                orders[fallback])) {
+                fallback = byDeadline[n];
+            }
+        }
+        if (best < 0) {
+            best = fallback;
+        }
+        if (best < 0) {
+            return false;
+        }
+
+        auto &target = orders[best].mixture.getIngredients();
+        int plate = -1;
+        int plateSize = -1;
+        for (int tile : containerTiles) {
+            if (containerKindAt(tile) != ContainerKind::Plate ||
+                reserved[tile] || isDishPlate(tile) || !isPlateSpot(tile) ||
+                !reachable(tile)) {
+                continue;
+            }
+            auto &mixture = mixtureAt(tile);
+            if (includes(target, mixture) && (int)mixture.size() > plateSize) {
+                plate = tile;
+                plateSize = mixture.size();
+            }
+        }
+        if (plate < 0) {
+            return false;
+        }
+        dishes.emplace_back(nextDishId++, target, plate);
+        return true;
+    }
+
+    // Plan one missing ingredient of the dish, the slow ones first.
+    bool planIngredient(Dish &dish, int cell, Task &task) {
+        auto missing = getMissing(dish);
+        for (int pass = 0; pass < 3; pass++) {
+            for (auto &ingredient : missing) {
+                auto recipe = sources[ingredient].recipe;
+                int rank = recipe == nullptr                      ? 2
+                           : recipe->tileKind == TileKind::Stove ? 0
+                                                                  : 1;
+                if (rank != pass ||
+                    !includes(missing, rank == 2
+                                           ? std::vector<std::string>{
+                                                 ingredient}
+                                           : recipe->result.getIngredients())) {
+                    continue;
+                }
+                if (rank == 0) {
+                    if (adopt(dish, recipe)) {
+                        return planIngredient(dish, cell, task);
+                    }
+                    if (planCook(dish, recipe, cell, task)) {
+                        return true;
+                    }
+                } else if (planDeliver(dish, ingredient, cell, task)) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    // Claim a pot that is already cooking the recipe and belongs to no
+    // dish.
+    bool adopt(Dish &dish, const Recipe *recipe) {
+        for (int tile : containerTiles) {
+            if (reserved[tile] || inCooking(tile) || !reachable(tile) ||
+                kindAt(tile) != recipe->tileKind ||
+                !isCooking(tile, recipe) || containerAt(tile)->isOvercooked()) {
+                continue;
+            }
+            dish.cooking.push_back(Cooking{tile, recipe});
+            return true;
+        }
+        return false;
+    }
+
+    // Steps that end with the ingredient in hand.
+    bool planHold(const std::string &ingredient, int cell, Task &task,
+                  int depth = 0) {
+        auto &source = sources[ingredient];
+        if (!source.boxes.empty()) {
+            int box = -1;
+            for (int tile : source.boxes) {
+                if (reachable(tile) &&
+                    (box < 0 || manhattan(tile, cell) < manhattan(box, cell))) {
+                    box = tile;
+                }
+            }
+            if (box < 0) {
+                return false;
+            }
+            task.steps.push_back(Step{StepKind::PickUp, box});
+            return true;
+        }
+        auto recipe = source.recipe;
+        if (recipe == nullptr || depth > 4 ||
+            recipe->tileKind != TileKind::ChoppingStation ||
+            recipe->ingredients.getIngredients().size() != 1) {
+            return false;
+        }
+        int station = nearest(TileKind::ChoppingStation, cell, true);
+        if (station < 0) {
+            return false;
+        }
+        reserve(task, station);
+        if (!planHold(recipe->ingredients.getIngredients()[0], station, task,
+                      depth + 1)) {
+            return false;
+        }
+        task.steps.push_back(Step{StepKind::PutDown, station, Need::Empty});
+        task.steps.push_back(Step{StepKind::Chop, station, Need::Any, recipe});
+        task.steps.push_back(Step{StepKind::PickUp, station, Need::Occupied});
+        return true;
+    }
+
+    bool planDeliver(Dish &dish, const std::string &ingredient, int cell,
+                     Task &task) {
+        if (!planHold(ingredient, cell, task)) {
+            return fail(task);
+        }
+        auto recipe = sources[ingredient].recipe;
+        task.kind = TaskKind::Deliver;
+        task.dish = dish.id;
+        task.promised = recipe == nullptr ? std::vector<std::string>{ingredient}
+                                          : recipe->result.getIngredients();
+        task.steps.push_back(
+            Step{StepKind::PutDown, dish.plate, Need::Occupied});
+        return true;
+    }
+
+    // Fill an empty pot on a stove, or carry one to a free stove first.
+    bool planCook(Dish &dish, const Recipe *recipe, int cell, Task &task) {
+        int pot = -1;
+        for (int tile : containerTiles) {
+            auto container = containerAt(tile);
+            if (container->getContainerKind() != recipe->containerKind ||
+                !container->isEmpty() || reserved[tile] || inCooking(tile) ||
+                !reachable(tile)) {
+                continue;
+            }
+            if (pot < 0 || (kindAt(tile) == recipe->tileKind &&
+                            kindAt(pot) != recipe->tileKind)) {
+                pot = tile;
+            }
+        }
+        if (pot < 0) {
+            return false;
+        }
+        int stove = pot;
+        reserve(task, pot);
+        if (kindAt(pot) != recipe->tileKind) {
+            stove = nearest(recipe->tileKind, pot, true);
+            if (stove < 0) {
+                return fail(task);
+            }
+            reserve(task, stove);
+            task.steps.push_back(Step{StepKind::PickUp, pot, Need::Occupied});
+            task.steps.push_back(Step{StepKind::PutDown, stove, Need::Empty});
+        }
+        for (auto &input : recipe->ingredients.getIngredients()) {
+            if (!planHold(input, stove, task)) {
+                return fail(task);
+            }
+            task.steps.push_back(
+                Step{StepKind::PutDown, stove, Need::Occupied});
+        }
+        task.kind = TaskKind::Cook;
+        task.dish = dish.id;
+        task.stove = stove;
+        task.recipe = recipe;
+        task.promised = recipe->result.getIngredients();
+        return true;
+    }
+
+    void finish(Bot &bot) {
+        auto &task = *bot.task;
+        auto dish = findDish(task.dish);
+        switch (task.kind) {
+        case TaskKind::Cook:
+            if (dish != nullptr) {
+                dish->cooking.push_back(Cooking{task.stove, task.recipe});
+            }
+            break;
+        case TaskKind::Collect:
+            if (dish != nullptr) {
+                std::erase_if(dish->cooking, [&](Cooking &cooking) {
+                    return cooking.stove == task.stove;
+                });
+            }
+            break;
+        case TaskKind::Serve:
+            eraseDish(task.dish);
+            break;
+        default:
+            break;
+        }
+        release(task);
+        bot.task.reset();
+    }
+
+    // Give up the task. Whatever the player holds is put away by the next
+    // one.
+    void abort(Bot &bot) {
+        auto &task = *bot.task;
+        auto dish = findDish(task.dish);
+        if (task.kind == TaskKind::Collect && dish != nullptr) {
+            for (auto &cooking : dish->cooking) {
+                if (cooking.stove == task.stove) {
+                    cooking.collecting = false;
+                }
+            }
+        }
+        if (task.kind == TaskKind::Serve) {
+            eraseDish(task.dish);
+        }
+        release(task);
+        bot.task.reset();
+    }
+
+    // Playing
+
+    void startStep(Bot &bot) {
+        bot.stepFrames = 0;
+        bot.attempts = 0;
+        bot.interactCooldown = 0;
+        bot.bestDistance = UNREACHABLE;
+        bot.stuckFrames = 0;
+        bot.detours = 0;
+        bot.detourFrames = 0;
+    }
+
+    bool isDone(Step &step, Player *player) {
+        auto hand = player->getOnHand();
+        switch (step.kind) {
+        case StepKind::PickUp:
+            return !hand->isNull();
+        case StepKind::PutDown:
+            return hand->isNull();
+        case StepKind::Pour:
+            return !hand->isNull() && hand->isEmpty();
+        case StepKind::Chop: {
+            auto container = containerAt(step.tile);
+            return !container->isNull() && !container->isWorking() &&
+                   container->getMixture() == step.recipe->result;
+        }
+        case StepKind::Wash:
+            return containerKindAt(step.tile) != ContainerKind::DirtyPlates;
+        }
+        return false;
+    }
+
+    // Whether the step can still be carried out.
+    bool isPossible(Step &step, Player *player) {
+        auto hand = player->getOnHand();
+        auto container = containerAt(step.tile);
+        bool handFree = hand->isNull();
+        if (step.kind == StepKind::PickUp || step.kind == StepKind::Chop ||
+            step.kind == StepKind::Wash) {
+            if (!handFree) {
+                return false;
+            }
+        } else if (handFree) {
+            return false;
+        }
+        if (step.kind == StepKind::Chop) {
+            return !container->isNull();
+        }
+        switch (step.need) {
+        case Need::Empty:
+            return container != nullptr && container->isNull();
+        case Need::Occupied:
+            return container != nullptr && !container->isNull();
+        default:
+            return true;
+        }
+    }
+
+    void play(Bot &bot, std::string &out) {
+        out = "Move";
+        auto player = gameManager->getPlayers()[bot.seat];
+        if (player->getRespawnCountdown() > 0) {
+            if (bot.task.has_value()) {
+                abort(bot);
+            }
+            return;
+        }
+        if (bot.backoff > 0) {
+            bot.backoff--;
+            yield(bot, player, out);
+            return;
+        }
+        // A finished step lets the next one start in the same frame.
+        for (int i = 0; i < 8; i++) {
+            if (!bot.task.has_value() && !assign(bot, player)) {
+                yield(bot, player, out);
+                return;
+            }
+            auto &task = *bot.task;
+            if (task.dish >= 0 && findDish(task.dish) == nullptr) {
+                abort(bot);
+                continue;
+            }
+            auto &step = task.steps[task.current];
+            if (isDone(step, player)) {
+                task.current++;
+                startStep(bot);
+                if (task.current == task.steps.size()) {
+                    finish(bot);
+                }
+                continue;
+            }
+            if (!perform(bot, player, step, out)) {
+                out = "Move";
+                abort(bot);
+                continue;
+            }
+            return;
+        }
+    }
+
+    // Whether the cell lies on a shortest way of a busy bot to its tile.
+    bool isInTheWay(Bot &bot, int cell) {
+        for (auto &other : bots) {
+            if (&other == &bot || !other.task.has_value()) {
+                continue;
+            }
+            int from = cellOf(gameManager->getPlayers()[other.seat]);
+            auto &step = other.task->steps[other.task->current];
+            auto &field = getField(step.tile);
+            if (from < 0 || field[cell] == UNREACHABLE ||
+                field[from] == UNREACHABLE) {
+                continue;
+            }
+            if (cell == from ||
+                manhattan(cell, from) + field[cell] <= field[from]) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // An idle bot steps off the ways of the others to the nearest free
+    // cell, and otherwise stands still.
+    void yield(Bot &bot, Player *player, std::string &out) {
+        int cell = cellOf(player);
+        if (cell < 0 || !isFloor(cell)) {
+            return;
+        }
+        int target = cell;
+        if (isInTheWay(bot, cell)) {
+            std::vector<int> taken;
+            for (auto other : gameManager->getPlayers()) {
+                int otherCell = cellOf(other);
+                if (other != player && otherCell >= 0) {
+                    taken.push_back(otherCell);
+                }
+            }
+            // Breadth-first from the cell, remembering the first move.
+            std::vector<int> first(tiles.size(), -1);
+            queue.clear();
+            queue.push_back(cell);
+            first[cell] = cell;
+            for (int head = 0; head < queue.size(); head++) {
+                int at = queue[head];
+                if (at != cell && !isInTheWay(bot, at) &&
+                    std::find(taken.begin(), taken.end(), at) == taken.end()) {
+                    target = first[at];
+                    break;
+                }
+                for (int k = 0; k < 4; k++) {
+                    int next = neighbour(at, k);
+                    if (next >= 0 && isFloor(next) && first[next] < 0) {
+                        first[next] = at == cell ? next : first[at];
+                        queue.push_back(next);
+                    }
+                }
+            }
+        }
+        auto pos = player->getPosition();
+        auto velocity = player->getVelocity();
+        int mx = steerAxis(target % width + 0.5f - pos.x, velocity.x);
+        int my = steerAxis(target / width + 0.5f - pos.y, velocity.y);
+        if (mx != 0 || my != 0) {
+            out = "Move ";
+            appendDirection(out, mx, my);
+        }
+    }
+
+    bool perform(Bot &bot, Player *player, Step &step, std::string &out) {
+        if (++bot.stepFrames > STEP_TIMEOUT || !isPossible(step, player)) {
+            return false;
+        }
+        bool interacting =
+            step.kind == StepKind::Chop || step.kind == StepKind::Wash;
+        int dx, dy;
+        int state = approach(bot, player, step.tile, interacting, out, dx, dy);
+        if (state < 0) {
+            return false;
+        }
+        if (state == 0) {
+            return true;
+        }
+        if (interacting) {
+            if (bot.interactCooldown > 0) {
+                bot.interactCooldown--;
+                return true;
+            }
+            bot.interactCooldown = REINTERACT_FRAMES;
+            out = "Interact ";
+        } else {
+            if (++bot.attempts > MAX_ATTEMPTS) {
+                return false;
+            }
+            out = "PutOrPick ";
+        }
+        appendDirection(out, dx, dy);
+        return true;
+    }
+
+    static void appendDirection(std::string &out, int dx, int dy) {
+        if (dx < 0) {
+            out += 'L';
+        } else if (dx > 0) {
+            out += 'R';
+        }
+        if (dy < 0) {
+            out += 'U';
+        } else if (dy > 0) {
+            out += 'D';
+        }
+    }
+
+    // Accelerate towards the target on one axis, braking in time to stop
+    // on it.
+    static int steerAxis(float offset, float velocity) {
+        float stop = velocity * std::fabs(velocity) / (2 * BRAKING);
+        float error = offset - stop;
+        if (std::fabs(error) < 0.05f) {
+            return 0;
+        }
+        return error > 0 ? 1 : -1;
+    }
+
+    // Walk to a cell next to the tile. Returns 1 once the player stands
+    // there, with the direction of the tile, 0 while on the way and -1 if
+    // the tile cannot be reached.
+    int approach(Bot &bot, Player *player, int tile, bool stand,
+                 std::string &out, int &dx, int &dy) {
+        int cell = cellOf(player);
+        if (cell < 0) {
+            return -1;
+        }
+        bool detour = bot.detourFrames > 0 && bot.detourTile == tile;
+        if (bot.detourFrames > 0) {
+            bot.detourFrames--;
+        }
+        if (detour && bot.detour[cell] == UNREACHABLE) {
+            detour = false;
+        }
+        auto &field = detour ? bot.detour : getField(tile);
+        uint16_t distance = field[cell];
+        if (distance == UNREACHABLE) {
+            return -1;
+        }
+
+        auto pos = player->getPosition();
+        auto velocity = player->getVelocity();
+        float targetX = cell % width + 0.5f;
+        float targetY = cell / width + 0.5f;
+        if (distance == 0) {
+            float offset =
+                std::hypot(pos.x - targetX, pos.y - targetY);
+            if (offset < ARRIVE_DISTANCE &&
+                velocity.Length() < (stand ? STAND_SPEED : ARRIVE_SPEED)) {
+                bot.stuckFrames = 0;
+                dx = tile % width - cell % width;
+                dy = tile / width - cell / width;
+                return 1;
+            }
+        } else {
+            // Head for the far end of the straight stretch of the path.
+            // The player keeps its way as long as that is still a shortest
+            // path, since every turn costs a stop; otherwise it takes the
+            // longest stretch.
+            static constexpr float DX[] = {1, -1, 0, 0};
+            static constexpr float DY[] = {0, 0, 1, -1};
+            int end = -1;
+            int length = 0;
+            bool ahead = false;
+            for (int k = 0; k < 4; k++) {
+                int next = neighbour(cell, k);
+                int n = 0;
+                int last = cell;
+                while (next >= 0 && field[next] != UNREACHABLE &&
+                       field[next] + 1 == field[last]) {
+                    last = next;
+                    next = neighbour(next, k);
+                    n++;
+                }
+                bool moving =
+                    velocity.x * DX[k] + velocity.y * DY[k] > ARRIVE_SPEED;
+                if (n > 0 && !ahead && (moving || n > length)) {
+                    length = n;
+                    end = last;
+                    ahead = moving;
+                }
+            }
+            if (end < 0) {
+                return -1;
+            }
+            targetX = end % width + 0.5f;
+            targetY = end / width + 0.5f;
+        }
+
+        if (distance < bot.bestDistance) {
+            bot.bestDistance = distance;
+            bot.stuckFrames = 0;
+        } else if (++bot.stuckFrames >
+                   STUCK_FRAMES * (1 + (&bot - bots.data()))) {
+            // Someone is in the way: go around the cells of the others for
+            // a while. The bots wait for different times, so that two of
+            // them do not step aside the same way.
+            if (++bot.detours > MAX_DETOURS) {
+                bot.backoff = BACKOFF_FRAMES * (1 + (&bot - bots.data()));
+                return -1;
+            }
+            std::vector<int> blocked;
+            for (auto other : gameManager->getPlayers()) {
+                int otherCell = cellOf(other);
+                if (other != player && otherCell >= 0) {
+                    blocked.push_back(otherCell);
+                }
+            }
+            buildField(tile, bot.detour, blocked);
+            bot.detourTile = tile;
+            bot.detourFrames = DETOUR_FRAMES;
+            bot.bestDistance = UNREACHABLE;
+            bot.stuckFrames = 0;
+        }
+
+        out = "Move ";
+        appendDirection(out, steerAxis(targetX - pos.x, velocity.x),
+                        steerAxis(targetY - pos.y, velocity.y));
+        return 0;
+    }
+};
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <box2d/box2d.h>
+
+#include "collisionlisener.h"
+#include "config.h"
+#include "physics.h"
+#include "tile.h"
+
+// The reference backend.
+class Box2DPhysics : public PhysicsBackend {
+  public:
+    Box2DPhysics() {
+        world = std::make_unique<b2World>(b2Vec2(0.0f, 0.0f));
+        world->SetContactListener(&collisionListener);
+    }
+
+    void init(StaticGeometry *geometry) override {
+        b2BodyDef bodyDef;
+        bodyDef.type = b2_staticBody;
+        bodyDef.userData.pointer =
+            reinterpret_cast<uintptr_t>(static_cast<IBody *>(geometry));
+        auto body = world->CreateBody(&bodyDef);
+        for (auto &rect : geometry->getRects()) {
+            b2PolygonShape shape;
+            shape.SetAsBox(
+                rect.w * 0.5f, rect.h * 0.5f,
+                b2Vec2(rect.x + rect.w * 0.5f, rect.y + rect.h * 0.5f), 0.0f);
+            b2FixtureDef fixtureDef;
+            fixtureDef.shape = &shape;
+            fixtureDef.filter.categoryBits = WALL_CATEGORY;
+            fixtureDef.filter.maskBits = PLAYER_CATEGORY;
+            body->CreateFixture(&fixtureDef);
+        }
+    }
+
+    int addCircle(b2Vec2 position, float radius, IBody *owner) override {
+        b2BodyDef bodyDef;
+        bodyDef.type = b2_dynamicBody;
+        bodyDef.position = position;
+        bodyDef.fixedRotation = true;
+        bodyDef.userData.pointer = reinterpret_cast<uintptr_t>(owner);
+        auto body = world->CreateBody(&bodyDef);
+        b2CircleShape shape;
+        shape.m_radius = radius;
+        b2FixtureDef fixtureDef;
+        fixtureDef.shape = &shape;
+        fixtureDef.density = 1.0f;
+        fixtureDef.filter.categoryBits = PLAYER_CATEGORY;
+        fixtureDef.filter.maskBits = PLAYER_CATEGORY | WALL_CATEGORY;
+        body->CreateFixture(&fixtureDef);
+
+        bodies.push_back(body);
+        return bodies.size() - 1;
+    }
+
+    b2Vec2 getPosition(int body) override {
+        return bodies[body]->GetPosition();
+    }
+    b2Vec2 getVelocity(int body) override {
+        return bodies[body]->GetLinearVelocity();
+    }
+    void setVelocity(int body, b2Vec2 velocity) override {
+        bodies[body]->SetLinearVelocity(velocity);
+    }
+    void applyForce(int body, b2Vec2 force) override {
+        bodies[body]->ApplyForceToCenter(force, true);
+    }
+    void setTransform(int body, b2Vec2 position) override {
+        bodies[body]->SetTransform(position, 0);
+    }
+    bool isEnabled(int body) override { return bodies[body]->IsEnabled(); }
+    void setEnabled(int body, bool enabled) override {
+        bodies[body]->SetEnabled(enabled);
+    }
+    bool isAwake(int body) override { return bodies[body]->IsAwake(); }
+    void setAwake(int body, bool awake) override {
+        bodies[body]->SetAwake(awake);
+    }
+
+    // The contact cache carries impulses from step to step, and the broad
+    // phase and contact order depend on the bodies' history, none of which
+    // can be saved. canRestore() stays false.
+
+    void step(float dt) override { world->Step(dt, 6, 2); }
+
+  protected:
+    // The listener must outlive the world, so it is declared first.
+    CollisionListener collisionListener;
+    std::unique_ptr<b2World> world;
+    std::vector<b2Body *> bodies;
+};
@@ -3,20 +3,27 @@
 #include <box2d/box2d.h>
 
 #include "interfaces.h"
-#include "player.h"
 
 class CollisionListener : public b2ContactListener {
     void BeginContact(b2Contact *contact) override {
+        auto fixtureA = contact->GetFixtureA();
+        auto fixtureB = contact->GetFixtureB();
+        // The category bits tell the players apart without touching the
+        // user data of the static geometry.
+        bool isPlayerA =
+            fixtureA->GetFilterData().categoryBits & PLAYER_CATEGORY;
+        bool isPlayerB =
+            fixtureB->GetFilterData().categoryBits & PLAYER_CATEGORY;
+
         auto entityA = reinterpret_cast<IBody *>(
-            contact->GetFixtureA()->GetBody()->GetUserData().pointer);
+            fixtureA->GetBody()->GetUserData().pointer);
         auto entityB = reinterpret_cast<IBody *>(
-            contact->GetFixtureB()->GetBody()->GetUserData().pointer);
-
-        if (entityA->getBodyKind() == BodyKind::Player) {
-            static_cast<Player *>(entityA)->collision(entityB);
+            fixtureB->GetBody()->GetUserData().pointer);
+        if (isPlayerA && entityA != nullptr) {
+            entityA->collision(entityB);
         }
-        if (entityB->getBodyKind() == BodyKind::Player) {
-            static_cast<Player *>(entityB)->collision(entityA);
+        if (isPlayerB && entityB != nullptr) {
+            entityB->collision(entityA);
         }
     }
 };
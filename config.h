@@ -24,6 +24,9 @@ constexpr int PLATE_RETURN_DELAY = 5 * FPS;
 
 constexpr std::chrono::milliseconds FIRST_RESPONSE_TIMEOUT{5000};
 constexpr std::chrono::milliseconds NORMAL_RESPONSE_TIMEOUT{20};
+// When timeouts are decided by CPU time, the wall time of a response is
+// still capped at this multiple of the timeout.
+constexpr int CPU_TIMEOUT_WALL_FACTOR = 5;
 
 constexpr float SCALE = 30;
 constexpr float BORDERWIDTHS = 1;
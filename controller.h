@@ -1,14 +1,22 @@
 #pragma once
 
+#include <algorithm>
 #include <chrono>
+#include <cmath>
 #include <condition_variable>
 #include <fstream>
 #include <iostream>
 #include <mutex>
 
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
 #include <tiny-process-library/process.hpp>
 
 #include "gamemanager.h"
+#include "metrics.h"
+#include "resourcemonitor.h"
 
 class Controller {
   protected:
@@ -22,6 +30,54 @@ class Controller {
     virtual std::vector<std::string> requestInputs() = 0;
 };
 
+struct AgentReport {
+    int frames = 0;
+    int timeouts = 0;
+    int mismatches = 0;
+    std::chrono::microseconds totalWallTime{0};
+    std::chrono::microseconds maxWallTime{0};
+    std::chrono::microseconds totalCpuTime{0};
+    std::chrono::microseconds maxCpuTime{0};
+    // Peak resident set size in kB.
+    long peakRss = 0;
+    // Wall time of every response, for the latency distribution.
+    std::vector<std::chrono::microseconds> wallTimes;
+
+    void print(std::ostream &os) const {
+        auto ms = [](std::chrono::microseconds t) { return t.count() / 1000.0; };
+        int n = std::max(frames, 1);
+        os << "Frames: " << frames << ", timeouts: " << timeouts
+           << ", mismatches: " << mismatches << "\n";
+        os << "Wall time: mean " << ms(totalWallTime) / n << "ms, max "
+           << ms(maxWallTime) << "ms\n";
+        if (!wallTimes.empty()) {
+            auto sorted = wallTimes;
+            std::sort(sorted.begin(), sorted.end());
+            auto percentile = [&](int p) {
+                return ms(sorted[(sorted.size() - 1) * p / 100]);
+            };
+            double mean = ms(totalWallTime) / n, variance = 0;
+            for (auto t : wallTimes) {
+                variance += (ms(t) - mean) * (ms(t) - mean);
+            }
+            variance /= wallTimes.size();
+            os << "Latency: p50 " << percentile(50) << "ms, p90 "
+               << percentile(90) << "ms, p99 " << percentile(99)
+               << "ms, jitter (stddev) " << std::sqrt(variance) << "ms\n";
+        }
+        os << "CPU time: total " << ms(totalCpuTime) << "ms, mean "
+           << ms(totalCpuTime) / n << "ms, max " << ms(maxCpuTime) << "ms\n";
+        os << "Peak RSS: " << peakRss << "kB\n";
+    }
+};
+
+enum class TimingMode {
+    // Every frame waits for the response of the same frame.
+    Lockstep,
+    // Frames never wait; the most recent response of each player is applied.
+    Realtime,
+};
+
 class CliController : public Controller {
     TinyProcessLib::Process *process;
     int frame = 0;
@@ -32,57 +88,92 @@ class CliController : public Controller {
     std::condition_variable cv;
     std::vector<std::string> nextInput;
 
+    TimingMode timingMode = TimingMode::Lockstep;
+    // Realtime mode: the latest accepted response and its frame.
+    std::vector<std::string> latestInput;
+    int latestFrame = -1;
+
+    // Chess-clock time bank in milliseconds, disabled when negative.
+    std::chrono::milliseconds timeBank{-1};
+    std::chrono::milliseconds timeBankLimit{-1};
+
     std::chrono::time_point<std::chrono::system_clock> requestTime;
     std::chrono::time_point<std::chrono::system_clock> responseTime;
 
+    ResourceMonitor monitor;
+    // Decide timeouts by the CPU time of the agent instead of wall time.
+    bool cpuTimeout = false;
+    std::chrono::microseconds requestCpuTime{0};
+    std::chrono::microseconds lastFrameCpuTime{0};
+    AgentReport report;
+    Metrics *metrics = nullptr;
+    // Reused for every request.
+    std::string request;
+
   public:
-    CliController(GameManager *g, const char *program) : Controller(g) {
+    CliController(GameManager *g, const char *program,
+                  const ResourceLimits &limits = ResourceLimits())
+        : Controller(g) {
         log.open("clilog.txt", std::ios::out | std::ios::trunc);
 
-        process = new TinyProcessLib::Process(
-            program, TinyProcessLib::Process::string_type(),
-            [&](const char *bytes, size_t n) {
-                std::string s(bytes, n);
-                if (log.is_open()) {
-                    log << "<<< Response: \n" << s << "\n<<<" << std::endl;
-                    log.flush();
-                }
+        auto readStdout = [&](const char *bytes, size_t n) {
+            std::string s(bytes, n);
+            if (log.is_open()) {
+                log << "<<< Response: \n" << s << "\n<<<" << std::endl;
+                log.flush();
+            }
 
-                std::stringstream ss(s);
+            std::stringstream ss(s);
 
-                ss >> s;
+            // A chunk may carry several responses when the agent runs
+            // behind in realtime mode.
+            while (ss >> s) {
                 assert(s == "Frame");
                 int responseFrame;
                 ss >> responseFrame;
                 std::getline(ss, s);
 
-                if (responseFrame != frame) {
-                    log << "!!! Frame mismatch: response " << responseFrame
-                        << " != current " << frame << std::endl;
-                    log.flush();
-                    return;
+                std::vector<std::string> input;
+                for (int i = 0; i < gameManager->getPlayers().size(); i++) {
+                    std::getline(ss, s);
+                    input.push_back(s);
                 }
+                onResponse(responseFrame, std::move(input));
+            }
+        };
+        auto readStderr = [&](const char *bytes, size_t n) {
+            std::string s(bytes, n);
+            if (log.is_open()) {
+                log << "<<< Stderr: \n" << s << "\n<<<" << std::endl;
+            }
+            if (printStderrToConsole) {
+                std::cerr << s;
+            }
+        };
 
-                responseTime = std::chrono::system_clock::now();
-                {
-                    std::unique_lock<std::mutex> lk(m);
-                    for (int i = 0; i < gameManager->getPlayers().size(); i++) {
-                        std::getline(ss, s);
-                        nextInput.push_back(s);
-                    }
-                }
-                cv.notify_all();
-            },
-            [&](const char *bytes, size_t n) {
-                std::string s(bytes, n);
-                if (log.is_open()) {
-                    log << "<<< Stderr: \n" << s << "\n<<<" << std::endl;
-                }
-                if (printStderrToConsole) {
-                    std::cerr << s;
-                }
-            },
-            true);
+#ifndef _WIN32
+        // The shell replaces itself with the agent, so that the monitored
+        // pid is the agent and not the shell waiting for it.
+        std::string command = std::string("exec ") + program;
+        if (!limits.isEmpty()) {
+            process = new TinyProcessLib::Process(
+                [command, limits] {
+                    limits.apply();
+                    execl("/bin/sh", "/bin/sh", "-c", command.c_str(),
+                          nullptr);
+                },
+                readStdout, readStderr, true);
+        } else {
+            process = new TinyProcessLib::Process(
+                command, TinyProcessLib::Process::string_type(), readStdout,
+                readStderr, true);
+        }
+#else
+        process = new TinyProcessLib::Process(
+            program, TinyProcessLib::Process::string_type(), readStdout,
+            readStderr, true);
+#endif
+        monitor.setPid(process->get_id());
     }
 
     ~CliController() {
@@ -101,96 +192,280 @@ class CliController : public Controller {
     }
 
     std::vector<std::string> requestInputs() override {
-        std::stringstream ss;
+        sendRequest();
+        return receiveInputs();
+    }
+
+    // The two halves of requestInputs(), so that the caller can do useful
+    // work while the agent is thinking.
+    void sendRequest() {
+        // The buffer and the strings of the containers keep their capacity,
+        // so a frame in which no container changed does not allocate.
+        auto &out = request;
+        out.clear();
         auto orderManager = &gameManager->orderManager;
-        ss << "Frame " << orderManager->getFrame() << "\n";
-        ss << orderManager->getTimeCountdown() << " ";
-        ss << orderManager->getFund() << "\n";
-        ss << orderManager->getOrders().size() << "\n";
+        out += "Frame ";
+        appendNumber(out, orderManager->getFrame());
+        if (timeBank.count() >= 0) {
+            out += ' ';
+            appendNumber(out, timeBank.count());
+        }
+        out += '\n';
+        appendNumber(out, orderManager->getTimeCountdown());
+        out += ' ';
+        appendNumber(out, orderManager->getFund());
+        out += '\n';
+        appendNumber(out, orderManager->getOrders().size());
+        out += '\n';
         for (auto &order : orderManager->getOrders()) {
-            ss << order.countdown << ' ' << order.price << ' '
-               << order.mixture.toString();
-            ss << '\n';
+            appendNumber(out, orderManager->getCountdown(order));
+            out += ' ';
+            appendNumber(out, order.price);
+            out += ' ';
+            order.mixture.appendTo(out);
+            out += '\n';
         }
-        ss << gameManager->getPlayers().size() << "\n";
+        appendNumber(out, gameManager->getPlayers().size());
+        out += '\n';
         for (auto &player : gameManager->getPlayers()) {
-            auto x = player->getBody()->GetPosition().x;
-            auto y = player->getBody()->GetPosition().y;
-            auto vx = player->getBody()->GetLinearVelocity().x;
-            auto vy = player->getBody()->GetLinearVelocity().y;
-            ss << x << ' ' << y << ' ' << vx << ' ' << vy;
-            ss << " " << player->getRespawnCountdown();
+            auto position = player->getPosition();
+            auto velocity = player->getVelocity();
+            appendNumber(out, position.x);
+            out += ' ';
+            appendNumber(out, position.y);
+            out += ' ';
+            appendNumber(out, velocity.x);
+            out += ' ';
+            appendNumber(out, velocity.y);
+            out += ' ';
+            appendNumber(out, player->getRespawnCountdown());
             if (!player->getOnHand()->isNull()) {
-                ss << " ; ";
-                printContainer(ss, player->getOnHand());
+                out += " ; ";
+                out += player->getOnHand()->getSerialized();
             }
-            ss << '\n';
+            out += '\n';
         }
+        // The count goes before the containers, it is inserted once they
+        // are written.
+        auto countPos = out.size();
         int count = 0;
-        for (auto &tile : gameManager->getTiles()) {
-            if (tile->getContainer() != nullptr &&
-                !tile->getContainer()->isNull()) {
+        for (auto &tile : gameManager->getContainerTiles()) {
+            auto container = tile->getContainer();
+            if (!container->isNull()) {
                 count++;
+                appendNumber(out, tile->getPos().x);
+                out += ' ';
+                appendNumber(out, tile->getPos().y);
+                out += ' ';
+                out += container->getSerialized();
+                out += '\n';
             }
         }
-        ss << count << "\n";
-        for (auto &tile : gameManager->getTiles()) {
-            if (tile->getContainer() != nullptr &&
-                !tile->getContainer()->isNull()) {
-                auto x = tile->getPos().x;
-                auto y = tile->getPos().y;
-                ss << x << ' ' << y << ' ';
-                printContainer(ss, tile->getContainer());
-                ss << '\n';
+        char countText[16];
+        auto countEnd =
+            std::to_chars(countText, countText + sizeof(countText) - 1, count)
+                .ptr;
+        *countEnd++ = '\n';
+        out.insert(countPos, countText, countEnd - countText);
+        out += '\0';
+        log << ">>> Request: \n" << out << "\n>>>" << std::endl;
+        // Before the clock starts, as finding the processes of the agent
+        // may take a while.
+        requestCpuTime = monitor.getCpuTime();
+        {
+            std::unique_lock<std::mutex> lk(m);
+            requestTime = std::chrono::system_clock::now();
+        }
+        process->write(out);
+    }
+
+    std::vector<std::string> receiveInputs() {
+        int exit_status;
+        if (process->try_get_exit_status(exit_status)) {
+            throw std::runtime_error("Process exited unexpectedly with status " +
+                                     std::to_string(exit_status));
+        }
+
+        std::vector<std::string> res;
+        if (timingMode == TimingMode::Realtime) {
+            res = takeLatestInputs();
+        } else {
+            res = waitInputs();
+        }
+
+        {
+            std::unique_lock<std::mutex> lk(m);
+            frame += 1;
+        }
+
+        return res;
+    }
+
+    void setPrintStderrToConsole(bool value) { printStderrToConsole = value; }
+    void setTimingMode(TimingMode mode) { timingMode = mode; }
+    void setTimeBank(std::chrono::milliseconds bank) {
+        timeBank = bank;
+        timeBankLimit = bank;
+    }
+    void setCpuTimeout(bool value) { cpuTimeout = value; }
+    void setMetrics(Metrics *metrics) { this->metrics = metrics; }
+
+    // Must be called while the agent is still running to see its peak RSS.
+    const AgentReport &getReport() {
+        report.peakRss = monitor.getPeakRss();
+        return report;
+    }
+
+  protected:
+    void onResponse(int responseFrame, std::vector<std::string> &&input) {
+        std::unique_lock<std::mutex> lk(m);
+        if (timingMode == TimingMode::Realtime) {
+            // Late responses are still the freshest intent of the agent, but
+            // one never overrides a newer one.
+            if (responseFrame > frame || responseFrame <= latestFrame) {
+                log << "!!! Frame mismatch: response " << responseFrame
+                    << " != current " << frame << std::endl;
+                countMismatch();
+                return;
             }
+            if (responseFrame == frame) {
+                responseTime = std::chrono::system_clock::now();
+            }
+            latestFrame = responseFrame;
+            latestInput = std::move(input);
+        } else {
+            if (responseFrame != frame) {
+                log << "!!! Frame mismatch: response " << responseFrame
+                    << " != current " << frame << std::endl;
+                log.flush();
+                countMismatch();
+                return;
+            }
+            responseTime = std::chrono::system_clock::now();
+            nextInput = std::move(input);
         }
-        ss << '\0';
-        log << ">>> Request: \n" << ss.str() << "\n>>>" << std::endl;
-        process->write(ss.str());
-        requestTime = std::chrono::system_clock::now();
+        lk.unlock();
+        cv.notify_all();
+    }
+
+    std::vector<std::string> idleInputs() {
+        return std::vector<std::string>(gameManager->getPlayers().size(),
+                                        "Move");
+    }
 
-        auto timeout =
+    std::vector<std::string> waitInputs() {
+        std::chrono::milliseconds timeout =
             (frame == 0 ? FIRST_RESPONSE_TIMEOUT : NORMAL_RESPONSE_TIMEOUT);
-        if (nextInput.size() == 0) {
-            int exit_status;
-            if (process->try_get_exit_status(exit_status)) {
-                throw std::runtime_error(
-                    "Process exited unexpectedly with status " +
-                    std::to_string(exit_status));
+        if (frame > 0 && timeBank.count() >= 0) {
+            timeout = timeBank;
+        }
+
+        std::unique_lock<std::mutex> lk(m);
+        auto ready = [&] { return nextInput.size() > 0; };
+        cv.wait_for(lk, timeout, ready);
+        if (cpuTimeout) {
+            // Waiting for a busy host is not the fault of the agent, so keep
+            // waiting until it has really used up its CPU time.
+            while (!ready()) {
+                auto used = monitor.getCpuTime() - requestCpuTime;
+                auto elapsed = std::chrono::system_clock::now() - requestTime;
+                if (used >= timeout ||
+                    elapsed >= timeout * CPU_TIMEOUT_WALL_FACTOR) {
+                    break;
+                }
+                cv.wait_for(lk,
+                            std::max<std::chrono::microseconds>(
+                                timeout - used, std::chrono::milliseconds(1)),
+                            ready);
             }
-            std::unique_lock<std::mutex> lk(m);
-            cv.wait_for(lk, std::chrono::milliseconds(timeout),
-                        [&] { return nextInput.size() > 0; });
         }
-        auto res = nextInput;
+        auto res = std::move(nextInput);
         nextInput.clear();
+        auto now = std::chrono::system_clock::now();
+        lk.unlock();
 
-        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
-            std::chrono::system_clock::now() - requestTime);
-        if (res.size() == 0 || duration > timeout) {
-            log << "!!! Response timeout: " << duration.count() << "ms"
-                << std::endl;
-            res.clear();
-            for (auto &player : gameManager->getPlayers()) {
-                res.push_back("Move");
-            }
+        auto duration = std::chrono::duration_cast<std::chrono::microseconds>(
+            now - requestTime);
+        auto cpuTime = monitor.getCpuTime() - requestCpuTime;
+        auto spent = cpuTimeout ? cpuTime : duration;
+        bool timedOut = res.size() == 0 || spent > timeout ||
+                        duration > timeout * CPU_TIMEOUT_WALL_FACTOR;
+        recordFrame(duration, cpuTime, timedOut);
+        if (timedOut) {
+            log << "!!! Response timeout: " << duration.count() / 1000
+                << "ms, CPU " << cpuTime.count() / 1000 << "ms" << std::endl;
+            res = idleInputs();
         } else {
-            log << "!!! Response time: " << duration.count() << "ms"
-                << std::endl;
+            log << "!!! Response time: " << duration.count() / 1000
+                << "ms, CPU " << cpuTime.count() / 1000 << "ms" << std::endl;
         }
 
-        frame += 1;
-
+        if (frame > 0 && timeBank.count() >= 0) {
+            timeBank -=
+                timedOut ? timeBank
+                         : std::chrono::duration_cast<std::chrono::milliseconds>(
+                               spent);
+            timeBank = std::min(timeBank + NORMAL_RESPONSE_TIMEOUT,
+                                std::max(timeBankLimit, NORMAL_RESPONSE_TIMEOUT));
+        }
         return res;
     }
 
-    void setPrintStderrToConsole(bool value) { printStderrToConsole = value; }
+    void recordFrame(std::chrono::microseconds wallTime,
+                     std::chrono::microseconds cpuTime, bool timedOut) {
+        report.frames++;
+        report.timeouts += timedOut;
+        report.totalWallTime += wallTime;
+        if (wallTime.count() > 0) {
+            report.wallTimes.push_back(wallTime);
+        }
+        report.maxWallTime = std::max(report.maxWallTime, wallTime);
+        report.totalCpuTime += cpuTime;
+        report.maxCpuTime = std::max(report.maxCpuTime, cpuTime);
+        if (metrics != nullptr) {
+            if (wallTime.count() > 0) {
+                metrics->record(Metric::AgentLatency,
+                                wallTime.count() / 1000.0f);
+            }
+            if (timedOut) {
+                metrics->count(Counter::Timeouts);
+            }
+        }
+    }
+
+    void countMismatch() {
+        report.mismatches++;
+        if (metrics != nullptr) {
+            metrics->count(Counter::Mismatches);
+        }
+    }
 
-    void printContainer(std::ostream &os, ContainerHolder *container) {
-        os << container->toString();
-        if (container->isWorking()) {
-            os << " ; " << container->getProgressTick() << " / "
-               << container->getProgressTickMax();
+    std::vector<std::string> takeLatestInputs() {
+        std::unique_lock<std::mutex> lk(m);
+        if (frame == 0) {
+            // Give the agent its start-up time before the clock runs.
+            cv.wait_for(lk, FIRST_RESPONSE_TIMEOUT,
+                        [&] { return latestFrame >= 0; });
+        }
+        // There is no response time in realtime mode, only the CPU time
+        // spent between two frames.
+        auto cpuTime = monitor.getCpuTime();
+        recordFrame(std::chrono::microseconds(0), cpuTime - lastFrameCpuTime,
+                    false);
+        lastFrameCpuTime = cpuTime;
+        if (latestFrame < 0) {
+            return idleInputs();
         }
+        log << "!!! Applying response of frame " << latestFrame << " at "
+            << frame << std::endl;
+        auto res = latestInput;
+        // Movement persists until the agent changes it, while PutOrPick and
+        // Interact happen only once.
+        for (auto &input : latestInput) {
+            if (!input.starts_with("Move")) {
+                input = "Move";
+            }
+        }
+        return res;
     }
 };
@@ -2,22 +2,28 @@
 
 #include "gamemanager.h"
 
-void EntityManager::step() {
-    current++;
-    while (!respawnQueue.empty() && current >= respawnQueue.top().first) {
-        ContainerHolder *container = respawnQueue.top().second;
-        respawnQueue.pop();
-        auto [x, y] = container->getRespawnPoint();
+// The first timer of a frame handles every respawn due in it, in the order
+// of the respawns rather than that of their timers, which loadState does
+// not keep.
+void EntityManager::onTimer(int tag) {
+    for (int i = 0; i < respawns.size();) {
+        auto &[time, container] = respawns[i];
+        if (time != timers->getNow()) {
+            i++;
+            continue;
+        }
+        auto [x, y] = container.getRespawnPoint();
         auto tile = gameManager->getTile(x, y);
         if (tile->getContainer()->isNull() ||
             (tile->getContainer()->getContainerKind() ==
                  ContainerKind::DirtyPlates &&
-             container->getContainerKind() == ContainerKind::DirtyPlates)) {
-            auto res = tile->put(*container);
+             container.getContainerKind() == ContainerKind::DirtyPlates)) {
+            auto res = tile->put(container);
             assert(res);
-            delete container;
+            respawns.erase(respawns.begin() + i);
         } else {
-            respawnQueue.push(std::make_pair(current + 1, container));
+            time = RESPAWN_BLOCKED;
+            i++;
         }
     }
 }
@@ -1,40 +1,93 @@
 #pragma once
 
-#include <queue>
+#include <algorithm>
+#include <utility>
+#include <vector>
 
 #include "foodcontainer.h"
+#include "gamestate.h"
+#include "timerwheel.h"
 
 class GameManager;
 
-// A comparer that only compares the first element of the pair
-struct CompareFirst {
-    template <typename T, typename U>
-    bool operator()(const std::pair<T, U> &left, const std::pair<T, U> &right) {
-        return left.first > right.first;
-    }
-};
-
-class EntityManager {
-    std::priority_queue<std::pair<int, ContainerHolder *>,
-                        std::vector<std::pair<int, ContainerHolder *>>,
-                        CompareFirst>
-        respawnQueue;
-    int current = 0;
+class EntityManager : public ITimerListener {
+    // Containers waiting to respawn, in the order they were scheduled, which
+    // is also the order in which those due in the same frame are handled.
+    // The first element is the frame of the respawn, or RESPAWN_BLOCKED
+    // while the respawn point is taken.
+    std::vector<std::pair<int, ContainerHolder>> respawns;
 
     GameManager *gameManager;
+    TimerWheel *timers = nullptr;
 
   public:
+    static constexpr int RESPAWN_BLOCKED = -1;
+
     EntityManager() {}
 
     void scheduleRespawn(ContainerHolder &&container, int delay) {
-        auto p = new ContainerHolder();
-        *p = std::move(container);
-        respawnQueue.push(std::make_pair(current + delay, p));
+        respawns.emplace_back(timers->getNow() + delay, std::move(container));
+        timers->schedule(respawns.back().first, this, 0);
+    }
+
+    void onTimer(int tag) override;
+
+    // Try the blocked respawns at the tile again in the next frame, as its
+    // container may have been taken. They move to the back, as if they were
+    // scheduled now.
+    void retryRespawns(int x, int y) {
+        auto isRetried = [&](std::pair<int, ContainerHolder> &respawn) {
+            return respawn.first == RESPAWN_BLOCKED &&
+                   respawn.second.getRespawnPoint() == std::make_pair(x, y);
+        };
+        if (std::none_of(respawns.begin(), respawns.end(), isRetried)) {
+            return;
+        }
+        auto retried = std::stable_partition(
+            respawns.begin(), respawns.end(),
+            [&](auto &respawn) { return !isRetried(respawn); });
+        for (auto it = retried; it != respawns.end(); ++it) {
+            it->first = timers->getNow() + 1;
+        }
+        timers->schedule(timers->getNow() + 1, this, 0);
+    }
+
+    void saveState(GameState &state) {
+        state.respawns.resize(respawns.size());
+        for (int i = 0; i < respawns.size(); i++) {
+            state.respawns[i].first = respawns[i].first;
+            state.respawns[i].second.copyFrom(respawns[i].second);
+        }
     }
 
-    void step();
+    // Expects the timers to be reset to the frame of the state.
+    void loadState(GameState &state) {
+        respawns.resize(state.respawns.size());
+        for (int i = 0; i < respawns.size(); i++) {
+            respawns[i].first = state.respawns[i].first;
+            respawns[i].second.copyFrom(state.respawns[i].second);
+            if (respawns[i].first != RESPAWN_BLOCKED) {
+                timers->schedule(respawns[i].first, this, 0);
+            }
+        }
+    }
+
+    // The waiting containers are few, so this is computed from scratch. They
+    // are keyed on their position, which only depends on the order they were
+    // scheduled in and is part of the state, since it decides the order of
+    // the respawns due in the same frame.
+    uint64_t hash() {
+        uint64_t result = 0;
+        for (int i = 0; i < respawns.size(); i++) {
+            StateHasher hasher;
+            hasher.add(respawns[i].first).add(respawns[i].second.hash());
+            result ^= componentHash(HashComponent::Respawn, i, hasher.get());
+        }
+        return result;
+    }
 
     void setGameManager(GameManager *gameManager) {
         this->gameManager = gameManager;
     }
+    void setTimers(TimerWheel *timers) { this->timers = timers; }
 };
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <stdexcept>
 
 enum class ContainerKind {
@@ -10,7 +11,7 @@ enum class ContainerKind {
     DirtyPlates,
 };
 
-enum class TileKind {
+enum class TileKind : uint8_t {
     None,
     Void,
     Floor,
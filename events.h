@@ -0,0 +1,126 @@
+#pragma once
+
+#include <tuple>
+#include <vector>
+
+// A plated dish handed in at a service window. price is 0 if it matched
+// no order.
+struct DishServedEvent {
+    int x, y;
+    int price;
+    float factor;
+};
+
+// Two bodies started touching. otherPlayer is -1 if the player ran into a
+// wall.
+struct CollisionEvent {
+    int player;
+    int otherPlayer;
+};
+
+// A player walked into the void and waits to respawn.
+struct PlayerFellEvent {
+    int player;
+    bool droppedContainer;
+};
+
+struct OrderExpiredEvent {
+    int orderId;
+};
+
+struct OvercookedEvent {
+    int x, y;
+};
+
+// One plate of a stack of dirty plates was washed at a sink.
+struct PlateWashedEvent {
+    int x, y;
+};
+
+template <typename Event> class IEventListener {
+  public:
+    // Called once per frame with the events of that frame, in the order in
+    // which they happened.
+    virtual void onEvents(int frame, const std::vector<Event> &events) = 0;
+};
+
+// The events of one type. Nothing is recorded while there are no
+// listeners, and the buffers keep their capacity between frames, so
+// publishing does not allocate once a game has warmed up.
+template <typename Event> class EventChannel {
+  public:
+    void subscribe(IEventListener<Event> *listener) {
+        listeners.push_back(listener);
+    }
+    void unsubscribe(IEventListener<Event> *listener) {
+        std::erase(listeners, listener);
+    }
+    bool hasListeners() const { return !listeners.empty(); }
+
+    void publish(const Event &event) {
+        if (listeners.empty()) {
+            return;
+        }
+        pending.push_back(event);
+    }
+
+    // Events published by the listeners go to the next frame.
+    void flush(int frame) {
+        if (pending.empty()) {
+            return;
+        }
+        delivering.swap(pending);
+        for (auto listener : listeners) {
+            listener->onEvents(frame, delivering);
+        }
+        delivering.clear();
+    }
+
+    void clear() { pending.clear(); }
+
+  protected:
+    std::vector<IEventListener<Event> *> listeners;
+    std::vector<Event> pending;
+    std::vector<Event> delivering;
+};
+
+template <typename... Events> class EventBus {
+  public:
+    template <typename Event> void subscribe(IEventListener<Event> *listener) {
+        channel<Event>().subscribe(listener);
+    }
+    template <typename Event>
+    void unsubscribe(IEventListener<Event> *listener) {
+        channel<Event>().unsubscribe(listener);
+    }
+    // Lets publishers skip the work of building an event nobody wants.
+    template <typename Event> bool hasListeners() {
+        return channel<Event>().hasListeners();
+    }
+
+    template <typename Event> void publish(const Event &event) {
+        channel<Event>().publish(event);
+    }
+
+    // Deliver the events of a frame, one type after the other in the order
+    // of the template arguments.
+    void flush(int frame) {
+        std::apply([frame](auto &...c) { (c.flush(frame), ...); }, channels);
+    }
+
+    // Drop the events that were not delivered yet.
+    void clear() {
+        std::apply([](auto &...c) { (c.clear(), ...); }, channels);
+    }
+
+  protected:
+    std::tuple<EventChannel<Events>...> channels;
+
+    template <typename Event> EventChannel<Event> &channel() {
+        return std::get<EventChannel<Event>>(channels);
+    }
+};
+
+using GameEventBus =
+    EventBus<DishServedEvent, CollisionEvent, PlayerFellEvent,
+             OrderExpiredEvent, OvercookedEvent, PlateWashedEvent>;
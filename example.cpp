@@ -1,61 +1,33 @@
-#include <cassert>
 #include <iostream>
-#include <sstream>
-#include <string>
+
+#include "agent.h"
 
 using namespace std;
 
 int main() {
-    std::ios::sync_with_stdio(false);
-    cerr.tie(nullptr);
-    cerr << std::nounitbuf;
-
-    std::string s;
-    std::stringstream ss;
-
-    int frame;
+    agent::Reader reader;
+    agent::Writer writer;
 
     // 读取初始地图信息
-    std::getline(cin, s, '\0');
-    ss << s;
-
-    int width, height;
-    ss >> width >> height;
-    cerr << "Map size: " << width << "x" << height << std::endl;
-
-    // 读取剩下的地图信息，此处仅作示例
-    frame = 1000000;
-    ss.str("");
-
-    for (int i = 0; i < frame; i++) {
-        std::getline(cin, s, '\0');
-        ss << s;
-
-        // 如果输入流中还有数据，说明游戏已经在请求下一帧了。
-        // 这时候我们应该跳过当前帧，以便能够及时响应游戏。
-        if (cin.rdbuf()->in_avail() > 0) {
-            cerr << "Warning: skipping frame " << i
-                 << " to catch up with the game" << std::endl;
-            continue;
+    auto &level = reader.readLevel();
+    cerr << "Map size: " << level.width << "x" << level.height << endl;
+
+    agent::Frame frame;
+    // 每次取到的都是游戏最新的请求。如果游戏已经请求了下一帧，
+    // 旧的请求会被跳过，以便能够及时响应游戏。
+    while (reader.nextFrame(frame)) {
+        if (frame.skipped > 0) {
+            cerr << "Warning: skipped " << frame.skipped
+                 << " frames to catch up with the game" << endl;
         }
 
-        // 读取当前帧的游戏状态
-        ss >> s;
-        assert(s == "Frame");
-        int currentFrame;
-        ss >> currentFrame;
-        assert(currentFrame == i);
-
-        // 读取剩下的信息，此处仅作示例
-        for (int k = 0; k < 1000000; k++)
-            ;
-        ss.str("");
+        // 当前帧的游戏状态都在 frame 中：订单、玩家和各处的容器。
 
-        // 输出当前帧的操作，此处仅作示例
-        cout << "Frame " << i << "\n";
-        cout << "Move R\n";
-        cout << "Move U\n";
-        // 不要忘记刷新输出流，否则游戏将无法及时收到响应
-        cout.flush();
+        // 输出当前帧的操作，此处仅作示例。没有给出操作的玩家保持不动，
+        // 所有操作一次性写出。
+        writer.begin(frame.frame);
+        writer.move(1, 0);
+        writer.move(0, -1);
+        writer.send(frame.players.size());
     }
 }
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstdint>
+
+#include <box2d/box2d.h>
+
+// A Q16.16 fixed-point number. Every operation is integer arithmetic, so
+// the results are the same with any compiler, optimization level and CPU.
+class Fixed {
+  public:
+    static constexpr int FRACTION_BITS = 16;
+    static constexpr int32_t ONE = 1 << FRACTION_BITS;
+
+    constexpr Fixed() : raw(0) {}
+    constexpr Fixed(int value) : raw(value * ONE) {}
+
+    static constexpr Fixed fromRaw(int32_t raw) {
+        Fixed f;
+        f.raw = raw;
+        return f;
+    }
+    // Scaling by a power of two is exact, only the rounding can differ from
+    // the float and it is done on integers.
+    static constexpr Fixed fromFloat(float value) {
+        return fromRaw(static_cast<int32_t>(
+            value * ONE + (value >= 0 ? 0.5f : -0.5f)));
+    }
+    constexpr float toFloat() const { return static_cast<float>(raw) / ONE; }
+    constexpr int32_t getRaw() const { return raw; }
+
+    constexpr Fixed operator-() const { return fromRaw(-raw); }
+    constexpr Fixed operator+(Fixed other) const {
+        return fromRaw(raw + other.raw);
+    }
+    constexpr Fixed operator-(Fixed other) const {
+        return fromRaw(raw - other.raw);
+    }
+    constexpr Fixed operator*(Fixed other) const {
+        return fromRaw(
+            static_cast<int32_t>((int64_t(raw) * other.raw) >> FRACTION_BITS));
+    }
+    constexpr Fixed operator/(Fixed other) const {
+        return fromRaw(static_cast<int32_t>((int64_t(raw) << FRACTION_BITS) /
+                                            other.raw));
+    }
+    Fixed &operator+=(Fixed other) { return *this = *this + other; }
+    Fixed &operator-=(Fixed other) { return *this = *this - other; }
+    Fixed &operator*=(Fixed other) { return *this = *this * other; }
+
+    constexpr auto operator<=>(const Fixed &other) const = default;
+
+  private:
+    int32_t raw;
+};
+
+// The integer square root, rounded down.
+inline uint64_t isqrt(uint64_t value) {
+    uint64_t result = 0;
+    uint64_t bit = uint64_t(1) << 62;
+    while (bit > value) {
+        bit >>= 2;
+    }
+    while (bit != 0) {
+        if (value >= result + bit) {
+            value -= result + bit;
+            result = (result >> 1) + bit;
+        } else {
+            result >>= 1;
+        }
+        bit >>= 2;
+    }
+    return result;
+}
+
+struct FixedVec2 {
+    Fixed x, y;
+
+    FixedVec2() {}
+    FixedVec2(Fixed x, Fixed y) : x(x), y(y) {}
+    explicit FixedVec2(b2Vec2 v)
+        : x(Fixed::fromFloat(v.x)), y(Fixed::fromFloat(v.y)) {}
+
+    b2Vec2 toB2() const { return b2Vec2(x.toFloat(), y.toFloat()); }
+
+    FixedVec2 operator-(FixedVec2 other) const {
+        return FixedVec2(x - other.x, y - other.y);
+    }
+    FixedVec2 operator*(Fixed s) const { return FixedVec2(x * s, y * s); }
+
+    // In Q32.32, so that comparing distances needs no square root.
+    int64_t lengthSquared() const {
+        return int64_t(x.getRaw()) * x.getRaw() +
+               int64_t(y.getRaw()) * y.getRaw();
+    }
+    Fixed length() const {
+        return Fixed::fromRaw(static_cast<int32_t>(isqrt(lengthSquared())));
+    }
+    bool isLongerThan(Fixed distance) const {
+        return lengthSquared() > int64_t(distance.getRaw()) * distance.getRaw();
+    }
+
+    FixedVec2 normalized() const {
+        auto l = length();
+        if (l.getRaw() == 0) {
+            return *this;
+        }
+        return FixedVec2(x / l, y / l);
+    }
+};
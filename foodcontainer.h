@@ -1,12 +1,16 @@
 #pragma once
 
+#include <algorithm>
 #include <assert.h>
+#include <limits>
+#include <optional>
 #include <string>
 
 #include "config.h"
 #include "enums.h"
 #include "mixture.h"
 #include "recipe.h"
+#include "serialize.h"
 
 class FoodContainer {
   public:
@@ -22,6 +26,31 @@ class FoodContainer {
 
     FoodContainer(FoodContainer &) = delete;
     FoodContainer &operator=(const FoodContainer &other) = delete;
+    FoodContainer(FoodContainer &&) = default;
+    FoodContainer &operator=(FoodContainer &&) = default;
+
+    // Explicit deep copy, used when the game state is saved or restored.
+    FoodContainer clone() {
+        FoodContainer res(containerKind, mixture);
+        res.respawnPoint = respawnPoint;
+        res.recipe = recipe;
+        res.progress = progress;
+        res.dirtyPlateCount = dirtyPlateCount;
+        res.overcooked = overcooked;
+        res.collided = collided;
+        return res;
+    }
+
+    void hash(StateHasher &hasher) {
+        hasher.add(int(containerKind));
+        mixture.hash(hasher);
+        hasher.add(respawnPoint.first).add(respawnPoint.second);
+        hasher.add(recipe != nullptr);
+        if (recipe != nullptr) {
+            recipe->hash(hasher);
+        }
+        hasher.add(progress).add(dirtyPlateCount).add(overcooked).add(collided);
+    }
 
     bool isNull() {
         return containerKind == ContainerKind::None && mixture.isEmpty();
@@ -40,6 +69,7 @@ class FoodContainer {
     }
 
     bool isWorking() { return recipe != nullptr; }
+    bool isOvercooked() { return overcooked; }
     bool matchRecipe(const Recipe *recipe) {
         return containerKind == recipe->containerKind &&
                mixture == recipe->ingredients;
@@ -186,34 +216,61 @@ class FoodContainer {
         return false;
     }
 
+    // How many calls to step() it takes until one of them changes more than
+    // the progress.
+    int getStepsUntilChange(TileKind tileKind) {
+        if (tileKind != recipe->tileKind) {
+            return std::numeric_limits<int>::max();
+        }
+        if (progress < recipe->time) {
+            return recipe->time - progress;
+        }
+        if (!overcooked) {
+            return std::max(recipe->time + OVERCOOK_TIME + 1 - progress, 1);
+        }
+        return std::numeric_limits<int>::max();
+    }
+
+    // The same as that many calls to step() that change nothing else.
+    void advance(TileKind tileKind, int steps) {
+        if (tileKind == recipe->tileKind) {
+            progress += steps;
+        }
+    }
+
     std::string toString() {
         std::string s;
+        appendTo(s);
+        return s;
+    }
+    void appendTo(std::string &out) {
         if (overcooked) {
-            s += "* ";
+            out += "* ";
         }
         if (collided) {
-            s += "@ ";
+            out += "@ ";
         }
         switch (containerKind) {
         case ContainerKind::None:
             break;
         case ContainerKind::Pan:
-            s += "Pan";
+            out += "Pan";
             break;
         case ContainerKind::Pot:
-            s += "Pot";
+            out += "Pot";
             break;
         case ContainerKind::Plate:
-            s += "Plate";
+            out += "Plate";
             break;
         case ContainerKind::DirtyPlates:
-            s += "DirtyPlates " + std::to_string(dirtyPlateCount);
+            out += "DirtyPlates ";
+            appendNumber(out, dirtyPlateCount);
             break;
         }
         if (!mixture.isEmpty()) {
-            s += " : " + mixture.toString();
+            out += " : ";
+            mixture.appendTo(out);
         }
-        return s;
     }
 
   protected:
@@ -231,50 +288,55 @@ class FoodContainer {
     bool collided = false;
 };
 
+// Holds the container inline, so tiles and players do not point to a
+// separate allocation. Moving a holder moves the container out of it.
 class ContainerHolder {
   public:
-    ContainerHolder() { container = nullptr; }
+    ContainerHolder() {}
     ContainerHolder(ContainerKind kind, const Mixture &mixture) {
-        container = new FoodContainer(kind, mixture);
+        container.emplace(kind, mixture);
     }
 
     ContainerHolder(const ContainerHolder &other) = delete;
-    ContainerHolder(ContainerHolder &&other) {
-        container = other.container;
-        other.container = nullptr;
-        propertyChanged = true;
-        other.propertyChanged = true;
+    ContainerHolder(ContainerHolder &&other)
+        : container(std::move(other.container)) {
+        other.container.reset();
+        markChanged();
+        other.markChanged();
     }
 
     ContainerHolder &operator=(const ContainerHolder &other) = delete;
     ContainerHolder &operator=(ContainerHolder &&other) {
-        if (container != nullptr) {
+        if (container.has_value()) {
             assert(isNull());
-            delete container;
         }
-        container = other.container;
-        other.container = nullptr;
-        propertyChanged = true;
-        other.propertyChanged = true;
+        container = std::move(other.container);
+        other.container.reset();
+        markChanged();
+        other.markChanged();
         return *this;
     }
 
-    ~ContainerHolder() {
-        if (container != nullptr) {
-            delete container;
+    // Replace the content of this holder with a deep copy of other.
+    void copyFrom(ContainerHolder &other) {
+        if (other.container.has_value()) {
+            container.emplace(other.container->clone());
+        } else {
+            container.reset();
         }
+        markChanged();
     }
 
     ContainerHolder move() {
         ContainerHolder res{};
-        res.container = this->container;
-        this->container = nullptr;
-        propertyChanged = true;
-        return std::move(res);
+        res.container = std::move(this->container);
+        this->container.reset();
+        markChanged();
+        return res;
     }
 
-    bool isNull() { return container == nullptr || container->isNull(); }
-    bool isEmpty() { return container == nullptr || container->isEmpty(); }
+    bool isNull() { return !container.has_value() || container->isNull(); }
+    bool isEmpty() { return !container.has_value() || container->isEmpty(); }
 
     ContainerKind getContainerKind() {
         return isNull() ? ContainerKind::None : container->getContainerKind();
@@ -282,16 +344,17 @@ class ContainerHolder {
     const Mixture &getMixture() { return container->getMixture(); }
     void setMixture(const Mixture &mixture) {
         container->setMixture(mixture);
-        propertyChanged = true;
+        markChanged();
     }
 
     bool isWorking() { return !isNull() && container->isWorking(); }
+    bool isOvercooked() { return !isNull() && container->isOvercooked(); }
     bool matchRecipe(const Recipe *recipe) {
         return container->matchRecipe(recipe);
     }
     void setRecipe(const Recipe *recipe) {
         container->setRecipe(recipe);
-        propertyChanged = true;
+        markChanged();
     }
 
     float getProgress() { return container->getProgress(); }
@@ -302,6 +365,7 @@ class ContainerHolder {
 
     void setRespawnPoint(std::pair<int, int> point) {
         container->setRespawnPoint(point);
+        hashChanged = true;
     }
     std::pair<int, int> getRespawnPoint() {
         return container->getRespawnPoint();
@@ -309,30 +373,76 @@ class ContainerHolder {
 
     void setCollided() {
         container->setCollided();
-        propertyChanged = true;
+        markChanged();
     }
 
     void removeOnePlate() {
         container->removeOnePlate();
-        propertyChanged = true;
+        markChanged();
     }
 
     bool step(TileKind tileKind) {
-        propertyChanged = true;
+        markChanged();
         return container->step(tileKind);
     }
 
-    bool isPropertyChanged() {
-        bool ret = propertyChanged;
-        propertyChanged = false;
+    int getStepsUntilChange(TileKind tileKind) {
+        return container->getStepsUntilChange(tileKind);
+    }
+    void advance(TileKind tileKind, int steps) {
+        container->advance(tileKind, steps);
+        markChanged();
+    }
+
+    // Goes up whenever the container changes, so any number of observers
+    // can tell whether what they saw last is still current.
+    uint32_t getVersion() { return version; }
+    // Whether the hash changed since the last call. Also covers what is not
+    // displayed.
+    bool isHashChanged() {
+        bool ret = hashChanged;
+        hashChanged = false;
         return ret;
     }
 
+    uint64_t hash() {
+        StateHasher hasher;
+        hasher.add(!isNull());
+        if (!isNull()) {
+            container->hash(hasher);
+        }
+        return hasher.get();
+    }
+
     std::string toString() {
         if (isNull())
             return "";
         return container->toString();
     }
+    void appendTo(std::string &out) {
+        if (!isNull()) {
+            container->appendTo(out);
+        }
+    }
+
+    // The container in the format of the agent protocol, with the progress
+    // of the recipe it is working on. Kept until the container changes.
+    const std::string &getSerialized() {
+        if (serializedChanged) {
+            serialized.clear();
+            if (!isNull()) {
+                container->appendTo(serialized);
+                if (container->isWorking()) {
+                    serialized += " ; ";
+                    appendNumber(serialized, container->getProgressTick());
+                    serialized += " / ";
+                    appendNumber(serialized, container->getProgressMaxTick());
+                }
+            }
+            serializedChanged = false;
+        }
+        return serialized;
+    }
 
     bool put(ContainerHolder &other) {
         if (other.isNull()) {
@@ -350,8 +460,8 @@ class ContainerHolder {
             other.getContainerKind() == ContainerKind::Plate &&
             container->getProgress() >= 1) {
             auto res = other.container->directPut(*container);
-            propertyChanged = true;
-            other.propertyChanged = true;
+            markChanged();
+            other.markChanged();
             return res;
         }
 
@@ -360,8 +470,8 @@ class ContainerHolder {
         if (container->getContainerKind() != ContainerKind::None &&
             !other.container->isEmpty()) {
             auto res = container->directPut(*other.container);
-            propertyChanged = true;
-            other.propertyChanged = true;
+            markChanged();
+            other.markChanged();
             return res;
         }
 
@@ -370,8 +480,8 @@ class ContainerHolder {
         if (container->getContainerKind() != ContainerKind::None &&
             !container->isEmpty() && other.container->isEmpty()) {
             auto res = other.container->directPut(*container);
-            propertyChanged = true;
-            other.propertyChanged = true;
+            markChanged();
+            other.markChanged();
             return res;
         }
 
@@ -379,8 +489,8 @@ class ContainerHolder {
         if (container->getContainerKind() != ContainerKind::None) {
             assert(container->isEmpty() && other.container->isEmpty());
             auto res = container->directPut(*other.container);
-            propertyChanged = true;
-            other.propertyChanged = true;
+            markChanged();
+            other.markChanged();
             return res;
         }
 
@@ -393,12 +503,22 @@ class ContainerHolder {
         }
 
         auto res = container->directPut(*other.container);
-        propertyChanged = true;
-        other.propertyChanged = true;
+        markChanged();
+        other.markChanged();
         return res;
     }
 
   protected:
-    FoodContainer *container = nullptr;
-    bool propertyChanged = false;
+    std::optional<FoodContainer> container;
+    // Starts above 0 so that it never matches a fresh observer.
+    uint32_t version = 1;
+    bool hashChanged = true;
+    std::string serialized;
+    bool serializedChanged = true;
+
+    void markChanged() {
+        version++;
+        hashChanged = true;
+        serializedChanged = true;
+    }
 };
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "config.h"
+
+enum class LatePolicy {
+    // Run the missed frames back to back until the loop is on schedule.
+    CatchUp,
+    // Skip the missed deadlines and carry on from the next one.
+    Drop,
+};
+
+// Paces a loop at a fixed rate. The deadlines are absolute points on
+// steady_clock, so the rate does not drift however long the loop runs.
+// Waiting sleeps until shortly before a deadline and spins for the rest,
+// since sleeps overshoot by the timer slack of the OS.
+class FrameScheduler {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    FrameScheduler(int fps = FPS, LatePolicy policy = LatePolicy::CatchUp)
+        : targetFps(fps), policy(policy),
+          period(std::chrono::nanoseconds(1000000000 / fps)) {}
+
+    void setPolicy(LatePolicy policy) { this->policy = policy; }
+    // How long before a deadline to stop sleeping and start spinning.
+    void setSpinTime(Clock::duration spinTime) { this->spinTime = spinTime; }
+
+    // Make the next deadline one period from now.
+    void start() {
+        auto now = Clock::now();
+        deadline = now + period;
+        startTime = now;
+        windowStart = now;
+        windowFrames = 0;
+        totalFrames = 0;
+    }
+
+    // Wait for the next deadline.
+    void wait() {
+        auto now = Clock::now();
+        if (now < deadline - spinTime) {
+            std::this_thread::sleep_until(deadline - spinTime);
+        }
+        while (Clock::now() < deadline) {
+            std::this_thread::yield();
+        }
+        now = Clock::now();
+        deadline += period;
+        if (policy == LatePolicy::Drop && deadline <= now) {
+            auto missed = (now - deadline) / period + 1;
+            deadline += missed * period;
+            droppedFrames += missed;
+        }
+
+        totalFrames++;
+        windowFrames++;
+        if (now - windowStart >= std::chrono::seconds(1)) {
+            std::chrono::duration<float> elapsed = now - windowStart;
+            actualFps = windowFrames / elapsed.count();
+            windowStart = now;
+            windowFrames = 0;
+        }
+    }
+
+    int getTargetFps() { return targetFps; }
+    // The rate of the last full second. Can be read from any thread.
+    float getActualFps() { return actualFps; }
+    int getDroppedFrames() { return droppedFrames; }
+    // The rate since start.
+    float getAverageFps() {
+        std::chrono::duration<float> elapsed = Clock::now() - startTime;
+        return elapsed.count() > 0 ? totalFrames / elapsed.count() : 0;
+    }
+
+  protected:
+    int targetFps;
+    LatePolicy policy;
+    Clock::duration period;
+    Clock::duration spinTime = std::chrono::milliseconds(2);
+    Clock::time_point deadline = Clock::now();
+
+    Clock::time_point startTime = Clock::now();
+    Clock::time_point windowStart = Clock::now();
+    int totalFrames = 0;
+    int windowFrames = 0;
+    std::atomic<float> actualFps = 0;
+    std::atomic<int> droppedFrames = 0;
+};
@@ -1,30 +1,66 @@
 #pragma once
 
+#include <algorithm>
 #include <fstream>
+#include <memory>
+#include <optional>
+#include <ostream>
 #include <sstream>
 #include <string>
 #include <vector>
 
 #include <box2d/box2d.h>
 
-#include "collisionlisener.h"
+#include "box2dphysics.h"
 #include "config.h"
 #include "entitymanager.h"
+#include "events.h"
 #include "foodcontainer.h"
+#include "gamestate.h"
+#include "gridphysics.h"
 #include "interfaces.h"
 #include "ordermanager.h"
+#include "physics.h"
 #include "player.h"
 #include "recipe.h"
+#include "statehash.h"
 #include "tile.h"
+#include "timerwheel.h"
+
+inline std::unique_ptr<PhysicsBackend> CreatePhysics(PhysicsKind kind) {
+    switch (kind) {
+    case PhysicsKind::Box2D:
+        return std::make_unique<Box2DPhysics>();
+    case PhysicsKind::Grid:
+        return std::make_unique<GridPhysics>();
+    case PhysicsKind::Validate:
+        return std::make_unique<ValidatingPhysics>(
+            std::make_unique<Box2DPhysics>(), std::make_unique<GridPhysics>());
+    }
+    throw std::runtime_error("CreatePhysics: Unknown physics kind");
+}
 
 class GameManager {
   public:
     GameManager() {}
+    GameManager(const GameManager &) = delete;
+    GameManager &operator=(const GameManager &) = delete;
+
+    // Must be called before loadLevel.
+    void setPhysicsKind(PhysicsKind kind) { physicsKind = kind; }
+    // Must be called before loadLevel. Moves players with fixed-point
+    // arithmetic; with the grid physics, a game is then bit-identical
+    // across compilers and CPUs.
+    void setFixedPoint(bool fixedPoint) { this->fixedPoint = fixedPoint; }
 
     void loadLevel(const std::string &path) {
 
-        world = new b2World(b2Vec2(0.0f, 0.0f));
-        world->SetContactListener(new CollisionListener());
+        physics = CreatePhysics(physicsKind);
+        timers.reset(0);
+        orderManager.setTimers(&timers);
+        orderManager.setEvents(&events);
+        entityManager.setTimers(&timers);
+        entityManager.setGameManager(this);
 
         std::ifstream in(path);
         // Ensure that the path is valid.
@@ -33,7 +69,7 @@ class GameManager {
         }
 
         in >> width >> height;
-        map.resize(width * height);
+        tileKinds.assign(width * height, TileKind::None);
         in >> std::noskipws;
         for (int i = 0; i < width * height; i++) {
             char kindChar;
@@ -41,14 +77,19 @@ class GameManager {
                 in >> kindChar;
             } while (kindChar == '\n' || kindChar == '\r');
 
-            if (kindChar >= 'A' && kindChar <= 'Z') {
-                map[i] = nullptr;
-            } else {
-                addTile(i, getTileKind(kindChar));
+            // Letters are filled in by the illustrations.
+            if (kindChar < 'A' || kindChar > 'Z') {
+                tileKinds[i] = getTileKind(kindChar);
             }
         }
         in >> std::skipws;
 
+        struct Pantry {
+            int pos;
+            std::string ingredient;
+            int price;
+        };
+        std::vector<Pantry> pantries;
         int illustrationCount;
         in >> illustrationCount;
         for (int i = 0; i < illustrationCount; i++) {
@@ -60,15 +101,36 @@ class GameManager {
                 std::string ingredient;
                 int price;
                 in >> ingredient >> price;
-                assert(map[pos] == nullptr);
-                addTile(pos, TileKind::IngredientBox);
-                auto pantry = static_cast<TileIngredientBox *>(map[pos]);
-                pantry->init(ingredient, price);
+                assert(tileKinds[pos] == TileKind::None);
+                tileKinds[pos] = TileKind::IngredientBox;
+                pantries.push_back(Pantry{pos, ingredient, price});
             } else {
                 throw std::runtime_error("Invalid illustration");
             }
         }
 
+        map.assign(width * height, nullptr);
+        tileStorage.reserve(tileKinds);
+        for (int i = 0; i < width * height; i++) {
+            if (tileKinds[i] != TileKind::None) {
+                addTile(i, tileKinds[i]);
+            }
+        }
+        for (auto &pantry : pantries) {
+            static_cast<TileIngredientBox *>(map[pantry.pos])
+                ->init(pantry.ingredient, pantry.price);
+        }
+        containerTiles.clear();
+        for (auto tile : map) {
+            if (tile != nullptr && tile->getContainer() != nullptr) {
+                containerTiles.push_back(tile);
+            }
+        }
+        containerHashes.assign(containerTiles.size(), 0);
+        tileHash = 0;
+        staticGeometry.build(map, width, height);
+        physics->init(&staticGeometry);
+
         int recipeCount;
         in >> recipeCount;
         for (int i = 0; i < recipeCount; i++) {
@@ -151,7 +213,6 @@ class GameManager {
 
         int entityCount;
         in >> entityCount;
-        entityManager.setGameManager(this);
         for (int i = 0; i < entityCount; i++) {
             int x, y;
             std::string s;
@@ -179,79 +240,340 @@ class GameManager {
         }
 
         in.close();
+
+        saveState(initialState);
     }
 
+    // Put the loaded level back into its initial state, reusing the bodies,
+    // tiles and buffers of the last game. Only Box2D, whose state cannot be
+    // restored, gets a new world built the way loadLevel built it, so that a
+    // reset game goes on exactly like a newly loaded one there too. With a
+    // seed, the orders are generated again from that seed instead of
+    // repeating the last game.
+    void reset(std::optional<unsigned> seed = std::nullopt) {
+        if (!physics->canRestore()) {
+            physics = CreatePhysics(physicsKind);
+            physics->init(&staticGeometry);
+            for (auto &player : players) {
+                player->initPhysics(physics.get());
+            }
+        }
+        loadState(initialState);
+        if (seed.has_value()) {
+            orderManager.restart(*seed);
+        }
+    }
+
+    // Only the awake updatables are stepped. Stoves are not updatables at
+    // all, they wait on their timers.
     void step() {
-        for (auto &i : updateList) {
+        updateActiveList();
+        activeTotal += activeList.size();
+        activeMax = std::max(activeMax, (int)activeList.size());
+        stepCount++;
+
+        for (auto &i : activeList) {
             i->update();
         }
-        world->Step(1.0f / FPS, 6, 2);
-        for (auto &i : updateList) {
+        physics->step(1.0f / FPS);
+        for (auto &player : players) {
+            if (!player->isAwake() && player->isDisturbed()) {
+                wake(player);
+            }
+        }
+        updateActiveList();
+        for (auto &i : activeList) {
             i->lateUpdate();
         }
+        timers.advance();
         orderManager.step();
-        entityManager.step();
+        if (!eventsHeld) {
+            events.flush(timers.getNow());
+        }
+
+        for (auto &i : activeList) {
+            if (i->canSleep()) {
+                i->awake = false;
+                activeChanged = true;
+            }
+        }
+    }
+
+    // While held, the events of the steps are kept back, so that steps
+    // undone by loadState are never reported. Releasing delivers the rest.
+    void holdEvents(bool hold) {
+        eventsHeld = hold;
+        if (!hold) {
+            events.flush(timers.getNow());
+        }
+    }
+
+    void wake(IUpdatable *updatable) {
+        if (!updatable->awake) {
+            updatable->awake = true;
+            activeChanged = true;
+        }
+    }
+
+    void printReport(std::ostream &os) {
+        os << "Active updatables: mean "
+           << (double)activeTotal / std::max(stepCount, 1) << ", max "
+           << activeMax << " of " << updateList.size() << "\n";
+        int solidTiles = 0;
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                solidTiles += staticGeometry.getRectIndex(x, y) >= 0;
+            }
+        }
+        os << "Static geometry: " << solidTiles << " solid tiles in "
+           << staticGeometry.getRects().size() << " rectangles\n";
+        physics->printReport(os);
+    }
+
+    // Skip up to maxFrames frames without input, as long as nothing but
+    // countdowns would change in them. Returns the number of frames skipped;
+    // 0 means that the next frame has to be stepped normally.
+    int fastForward(int maxFrames) {
+        int frames = std::min(maxFrames,
+                              timers.getNextDeadline() - timers.getNow() - 1);
+        updateActiveList();
+        for (auto &i : activeList) {
+            if (frames <= 0) {
+                return 0;
+            }
+            frames = std::min(frames, i->getIdleFrames());
+        }
+        if (frames <= 0) {
+            return 0;
+        }
+        for (int i = 0; i < frames; i++) {
+            timers.advance();
+        }
+        for (auto &i : activeList) {
+            i->skipFrames(frames);
+        }
+        orderManager.skipFrames(frames);
+        return frames;
+    }
+
+    // Whether loadState gives back exactly the game that was saved, which
+    // depends on the physics. Box2D keeps a contact cache and sleep timers
+    // that cannot be saved, so a game restored there goes on differently.
+    bool canRestore() { return physics->canRestore(); }
+
+    // Save or restore everything that changes while the game runs, including
+    // the contacts of the physics that decide which collisions are new.
+    void saveState(GameState &state) {
+        state.frame = timers.getNow();
+        state.players.resize(players.size());
+        for (int i = 0; i < players.size(); i++) {
+            players[i]->saveState(state.players[i]);
+        }
+        physics->saveContacts(state.contacts);
+        state.tileContainers.resize(containerTiles.size());
+        for (int i = 0; i < containerTiles.size(); i++) {
+            state.tileContainers[i].copyFrom(
+                *containerTiles[i]->getContainer());
+        }
+        entityManager.saveState(state);
+        state.orderManager = orderManager;
+    }
+
+    // The timers are rebuilt from the deadlines kept in the state.
+    void loadState(GameState &state) {
+        timers.reset(state.frame);
+        events.clear();
+        for (auto &i : updateList) {
+            wake(i);
+        }
+        for (int i = 0; i < players.size(); i++) {
+            players[i]->loadState(state.players[i]);
+        }
+        // After the players, since disabling a body drops its contacts.
+        physics->loadContacts(state.contacts);
+        for (int i = 0; i < containerTiles.size(); i++) {
+            containerTiles[i]->loadContainer(state.tileContainers[i]);
+        }
+        entityManager.loadState(state);
+        orderManager = state.orderManager;
+        orderManager.scheduleOrders();
+    }
+
+    // A hash of everything a GameState keeps. Only the containers that
+    // changed since the last call are hashed again; orders keep their own
+    // running hash, and the few players, respawns and physics contacts are
+    // always rehashed.
+    uint64_t getStateHash() {
+        for (int i = 0; i < containerTiles.size(); i++) {
+            auto container = containerTiles[i]->getContainer();
+            if (container->isHashChanged()) {
+                tileHash ^= containerHashes[i];
+                containerHashes[i] =
+                    componentHash(HashComponent::Tile, i, container->hash());
+                tileHash ^= containerHashes[i];
+            }
+        }
+        return tileHash ^ orderManager.getOrderHash() ^ getVolatileHash();
+    }
+
+    // The same as getStateHash, computed from scratch to verify it.
+    uint64_t computeStateHash() {
+        uint64_t result = 0;
+        for (int i = 0; i < containerTiles.size(); i++) {
+            result ^= componentHash(HashComponent::Tile, i,
+                                    containerTiles[i]->getContainer()->hash());
+        }
+        for (auto &order : orderManager.getOrders()) {
+            result ^= order.hash();
+        }
+        return result ^ getVolatileHash();
     }
 
-    const b2World *getWorld() { return world; }
+    PhysicsBackend *getPhysics() { return physics.get(); }
+    TimerWheel *getTimers() { return &timers; }
 
+    int getWidth() { return width; }
+    int getHeight() { return height; }
     Tile *getTile(int x, int y) {
         if (x < 0 || x >= width || y < 0 || y >= height) {
             return nullptr;
         }
         return map[x + y * width];
     }
+    // Cheaper than getTile when only the kind is needed; None outside of
+    // the map.
+    TileKind getTileKindAt(int x, int y) {
+        if (x < 0 || x >= width || y < 0 || y >= height) {
+            return TileKind::None;
+        }
+        return tileKinds[x + y * width];
+    }
 
     const std::vector<Player *> &getPlayers() { return players; }
     const std::vector<Tile *> &getTiles() { return map; }
+    // The tiles that can hold a container, in the same order.
+    const std::vector<Tile *> &getContainerTiles() { return containerTiles; }
     const std::vector<Recipe> &getRecipes() { return recipes; }
     const std::vector<Order> &getOrders() { return orderManager.getOrders(); }
 
     void move(int playerId, b2Vec2 direction) {
+        if (direction.LengthSquared() != 0) {
+            wake(players[playerId]);
+        }
         players[playerId]->move(direction);
     }
     void interact(int playerId, int x, int y) {
+        wake(players[playerId]);
         players[playerId]->interact(getTile(x, y));
     }
     void putOrPick(int playerId, int x, int y) {
         players[playerId]->putOrPick(getTile(x, y));
+        entityManager.retryRespawns(x, y);
     }
 
     friend class GuiManager;
 
     OrderManager orderManager;
     EntityManager entityManager;
+    // Delivered at the end of every step.
+    GameEventBus events;
 
   protected:
-    b2World *world;
+    PhysicsKind physicsKind = PhysicsKind::Box2D;
+    std::unique_ptr<PhysicsBackend> physics;
+    bool fixedPoint = false;
+    bool eventsHeld = false;
+    // Shared by everything that waits for a frame: orders, respawns and
+    // cooking.
+    TimerWheel timers;
 
     int width;
     int height;
     std::vector<Player *> players;
+    // A view of tileStorage; nullptr where tileKinds is None.
     std::vector<Tile *> map;
+    std::vector<TileKind> tileKinds;
+    // The tiles that hold a container, the only ones a GameState keeps.
+    std::vector<Tile *> containerTiles;
+    // The hash keys of the containers on containerTiles, and their XOR.
+    std::vector<uint64_t> containerHashes;
+    uint64_t tileHash = 0;
+    // Reused by getVolatileHash.
+    std::vector<int> hashedContacts;
+
+    // The part of the state hash that is rebuilt on every call.
+    uint64_t getVolatileHash() {
+        StateHasher hasher;
+        hasher.add(timers.getNow());
+        orderManager.hash(hasher);
+        uint64_t result =
+            componentHash(HashComponent::Globals, 0, hasher.get());
+        for (auto &player : players) {
+            result ^= player->hash();
+        }
+        // Empty with Box2D, which cannot save its contacts.
+        physics->saveContacts(hashedContacts);
+        StateHasher contactHasher;
+        for (int id : hashedContacts) {
+            contactHasher.add(id);
+        }
+        result ^=
+            componentHash(HashComponent::Contacts, 0, contactHasher.get());
+        return result ^ entityManager.hash();
+    }
     std::vector<Recipe> recipes;
 
+    // Owners of the objects that players and map point to.
+    std::vector<std::unique_ptr<Player>> playerStorage;
+    TileStorage tileStorage;
+    StaticGeometry staticGeometry;
+
     std::vector<IUpdatable *> updateList;
+    // The awake part of updateList, in the same order.
+    std::vector<IUpdatable *> activeList;
+    bool activeChanged = true;
+    long long activeTotal = 0;
+    int activeMax = 0;
+    int stepCount = 0;
+
+    void updateActiveList() {
+        if (!activeChanged) {
+            return;
+        }
+        activeList.clear();
+        for (auto &i : updateList) {
+            if (i->isAwake()) {
+                activeList.push_back(i);
+            }
+        }
+        activeChanged = false;
+    }
+
+    GameState initialState;
 
     void addPlayer(float x, float y) {
-        auto player = new Player();
+        auto player = std::make_unique<Player>();
         player->setSpawnPoint(b2Vec2(x, y));
-        player->initB2(world);
+        player->initPhysics(physics.get());
+        player->setFixedPoint(fixedPoint);
         player->setLevelManager(this);
 
-        players.push_back(player);
-        updateList.push_back(player);
+        player->setId(players.size());
+        players.push_back(player.get());
+        updateList.push_back(player.get());
+        activeChanged = true;
+        playerStorage.push_back(std::move(player));
     }
 
     void addTile(int i, TileKind kind) {
-        map[i] = CreateTile(kind);
+        map[i] = tileStorage.create(kind);
         map[i]->setPos(b2Vec2(i % width, i / width));
-        map[i]->initB2(world);
         map[i]->setGameManager(this);
 
         auto iUpdatable = dynamic_cast<IUpdatable *>(map[i]);
         if (iUpdatable != nullptr) {
             updateList.push_back(iUpdatable);
+            activeChanged = true;
         }
     }
 };
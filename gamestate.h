@@ -0,0 +1,37 @@
+#pragma once
+
+#include <utility>
+#include <vector>
+
+#include <box2d/box2d.h>
+
+#include "foodcontainer.h"
+#include "ordermanager.h"
+
+class Tile;
+
+struct PlayerState {
+    b2Vec2 position;
+    b2Vec2 velocity;
+    bool enabled = true;
+    bool awake = true;
+    int respawnCountdown = 0;
+    ContainerHolder onHand;
+    Tile *tileInteracting = nullptr;
+    b2Vec2 moveDirection;
+};
+
+// Everything that changes while a game runs. Static data such as the map
+// layout and recipes stays in GameManager.
+struct GameState {
+    int frame = 0;
+    std::vector<PlayerState> players;
+    // See PhysicsBackend::saveContacts.
+    std::vector<int> contacts;
+    // Containers on the tiles that can hold one, in the order of
+    // GameManager::getTiles().
+    std::vector<ContainerHolder> tileContainers;
+    // In the order of EntityManager, which decides the order of respawns.
+    std::vector<std::pair<int, ContainerHolder>> respawns;
+    OrderManager orderManager;
+};
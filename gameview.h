@@ -0,0 +1,42 @@
+#pragma once
+
+#include <QGraphicsView>
+#include <QWheelEvent>
+#include <algorithm>
+#include <cmath>
+
+#include "config.h"
+#include "guimanager.h"
+
+// Zooms with the wheel around the cursor and pans by dragging. The view
+// only paints the regions that changed and the items in sight, and tells
+// the scene when the tiles get too small for details.
+class GameView : public QGraphicsView {
+  public:
+    static constexpr double MIN_ZOOM = 0.02;
+    static constexpr double MAX_ZOOM = 4;
+
+    GameView(GuiManager *guiManager, QWidget *parent = nullptr)
+        : QGraphicsView(guiManager, parent), guiManager(guiManager) {
+        setFrameStyle(QFrame::NoFrame);
+        setDragMode(ScrollHandDrag);
+        setTransformationAnchor(AnchorUnderMouse);
+        setViewportUpdateMode(MinimalViewportUpdate);
+    }
+
+    void setZoom(double zoom) {
+        zoom = std::clamp(zoom, MIN_ZOOM, MAX_ZOOM);
+        setTransform(QTransform::fromScale(zoom, zoom));
+        guiManager->setDetailed(zoom * SCALE >= DETAIL_TILE_PIXELS);
+    }
+    double getZoom() { return transform().m11(); }
+
+  protected:
+    GuiManager *guiManager;
+
+    void wheelEvent(QWheelEvent *event) override {
+        // One notch of a usual wheel is 120 and zooms by about 20%.
+        setZoom(getZoom() * std::pow(1.0015, event->angleDelta().y()));
+        event->accept();
+    }
+};
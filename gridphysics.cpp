@@ -0,0 +1,257 @@
+#include "gridphysics.h"
+
+#include <algorithm>
+#include <cmath>
+
+// The constants of Box2D that shape how bodies come to rest.
+namespace {
+constexpr float LINEAR_SLOP = 0.005f;
+// Box2D rounds polygons by this radius, so walls are a bit thicker.
+constexpr float POLYGON_RADIUS = 2.0f * LINEAR_SLOP;
+constexpr float MAX_TRANSLATION = 2.0f;
+constexpr float BAUMGARTE = 0.2f;
+constexpr float MAX_LINEAR_CORRECTION = 0.2f;
+constexpr float FRICTION = 0.2f;
+constexpr int VELOCITY_ITERATIONS = 6;
+constexpr int POSITION_ITERATIONS = 2;
+constexpr float PI = 3.14159265359f;
+
+bool contains(const std::vector<int> &ids, int id) {
+    return std::find(ids.begin(), ids.end(), id) != ids.end();
+}
+
+// The separation of a circle from a rectangle and the direction to push it
+// out along.
+float rectSeparation(const StaticGeometry::Rect &rect, b2Vec2 center,
+                     float radius, b2Vec2 &normal) {
+    float left = rect.x, right = rect.x + rect.w;
+    float top = rect.y, bottom = rect.y + rect.h;
+    b2Vec2 closest(std::clamp(center.x, left, right),
+                   std::clamp(center.y, top, bottom));
+    b2Vec2 d = center - closest;
+    float distance = d.Length();
+    if (distance > 0) {
+        normal = (1.0f / distance) * d;
+        return distance - radius - POLYGON_RADIUS;
+    }
+
+    // The center is inside, leave through the nearest side.
+    float depths[4] = {center.x - left, right - center.x, center.y - top,
+                       bottom - center.y};
+    b2Vec2 normals[4] = {b2Vec2(-1, 0), b2Vec2(1, 0), b2Vec2(0, -1),
+                         b2Vec2(0, 1)};
+    int side = std::min_element(depths, depths + 4) - depths;
+    normal = normals[side];
+    return -depths[side] - radius - POLYGON_RADIUS;
+}
+} // namespace
+
+void GridPhysics::init(StaticGeometry *geometry) { this->geometry = geometry; }
+
+int GridPhysics::addCircle(b2Vec2 position, float radius, IBody *owner) {
+    Circle circle;
+    circle.position = position;
+    circle.radius = radius;
+    // Density 1, like the fixtures of the Box2D backend.
+    circle.invMass = 1.0f / (PI * radius * radius);
+    circle.owner = owner;
+    circles.push_back(std::move(circle));
+    return circles.size() - 1;
+}
+
+void GridPhysics::findRectContacts(int i) {
+    auto &circle = circles[i];
+    float reach = circle.radius + POLYGON_RADIUS;
+    int x0 = std::floor(circle.position.x - reach);
+    int x1 = std::floor(circle.position.x + reach);
+    int y0 = std::floor(circle.position.y - reach);
+    int y1 = std::floor(circle.position.y + reach);
+
+    nearbyRects.clear();
+    for (int y = y0; y <= y1; y++) {
+        for (int x = x0; x <= x1; x++) {
+            int id = geometry->getRectIndex(x, y);
+            if (id >= 0 && !contains(nearbyRects, id)) {
+                nearbyRects.push_back(id);
+            }
+        }
+    }
+
+    auto &rects = geometry->getRects();
+    for (auto id : nearbyRects) {
+        b2Vec2 normal;
+        float separation =
+            rectSeparation(rects[id], circle.position, circle.radius, normal);
+        if (separation > 0) {
+            continue;
+        }
+        contacts.push_back(Contact{i, -1, id, normal, separation, 0, 0});
+        circle.touchingNext.push_back(id);
+    }
+}
+
+void GridPhysics::findContacts() {
+    contacts.clear();
+    for (auto &circle : circles) {
+        circle.touchingNext.clear();
+    }
+
+    for (int i = 0; i < circles.size(); i++) {
+        if (!circles[i].enabled) {
+            continue;
+        }
+        if (geometry != nullptr) {
+            findRectContacts(i);
+        }
+        for (int j = i + 1; j < circles.size(); j++) {
+            if (!circles[j].enabled) {
+                continue;
+            }
+            b2Vec2 d = circles[i].position - circles[j].position;
+            float radius = circles[i].radius + circles[j].radius;
+            if (d.LengthSquared() > radius * radius) {
+                continue;
+            }
+            float distance = d.Length();
+            b2Vec2 normal =
+                distance > 0 ? (1.0f / distance) * d : b2Vec2(1.0f, 0.0f);
+            contacts.push_back(
+                Contact{i, j, -1, normal, distance - radius, 0, 0});
+            circles[i].touchingNext.push_back(-1 - j);
+            circles[j].touchingNext.push_back(-1 - i);
+        }
+    }
+
+    // Report the contacts that began in this step, in the order of the
+    // circles so that it does not depend on anything else.
+    for (auto &circle : circles) {
+        if (circle.owner != nullptr) {
+            for (auto id : circle.touchingNext) {
+                if (contains(circle.touching, id)) {
+                    continue;
+                }
+                IBody *other = id >= 0 ? static_cast<IBody *>(geometry)
+                                       : circles[-1 - id].owner;
+                circle.owner->collision(other);
+            }
+        }
+        std::swap(circle.touching, circle.touchingNext);
+    }
+}
+
+// For every circle, the number of things it touches followed by them.
+void GridPhysics::saveContacts(std::vector<int> &contacts) {
+    contacts.clear();
+    for (auto &circle : circles) {
+        contacts.push_back(circle.touching.size());
+        contacts.insert(contacts.end(), circle.touching.begin(),
+                        circle.touching.end());
+    }
+}
+
+void GridPhysics::loadContacts(const std::vector<int> &contacts) {
+    auto p = contacts.begin();
+    for (auto &circle : circles) {
+        int count = *p++;
+        circle.touching.assign(p, p + count);
+        p += count;
+    }
+}
+
+void GridPhysics::solveVelocities() {
+    for (int iteration = 0; iteration < VELOCITY_ITERATIONS; iteration++) {
+        for (auto &contact : contacts) {
+            auto &a = circles[contact.a];
+            Circle *b = contact.b >= 0 ? &circles[contact.b] : nullptr;
+            float invMassB = b != nullptr ? b->invMass : 0.0f;
+            float mass = 1.0f / (a.invMass + invMassB);
+            b2Vec2 velocityB = b != nullptr ? b->velocity : b2Vec2(0, 0);
+            b2Vec2 tangent(-contact.normal.y, contact.normal.x);
+
+            // Friction first, bounded by the current normal impulse.
+            float vt = b2Dot(a.velocity - velocityB, tangent);
+            float maxFriction = FRICTION * contact.normalImpulse;
+            float tangentImpulse =
+                std::clamp(contact.tangentImpulse - vt * mass, -maxFriction,
+                           maxFriction);
+            float lambda = tangentImpulse - contact.tangentImpulse;
+            contact.tangentImpulse = tangentImpulse;
+            a.velocity += (lambda * a.invMass) * tangent;
+            if (b != nullptr) {
+                b->velocity -= (lambda * invMassB) * tangent;
+            }
+
+            velocityB = b != nullptr ? b->velocity : b2Vec2(0, 0);
+            float vn = b2Dot(a.velocity - velocityB, contact.normal);
+            float normalImpulse =
+                std::max(contact.normalImpulse - vn * mass, 0.0f);
+            lambda = normalImpulse - contact.normalImpulse;
+            contact.normalImpulse = normalImpulse;
+            a.velocity += (lambda * a.invMass) * contact.normal;
+            if (b != nullptr) {
+                b->velocity -= (lambda * invMassB) * contact.normal;
+            }
+        }
+    }
+}
+
+void GridPhysics::solvePositions() {
+    auto &rects = geometry->getRects();
+    for (int iteration = 0; iteration < POSITION_ITERATIONS; iteration++) {
+        for (auto &contact : contacts) {
+            auto &a = circles[contact.a];
+            Circle *b = contact.b >= 0 ? &circles[contact.b] : nullptr;
+            float invMassB = b != nullptr ? b->invMass : 0.0f;
+
+            b2Vec2 normal;
+            float separation;
+            if (b != nullptr) {
+                b2Vec2 d = a.position - b->position;
+                float distance = d.Length();
+                normal = distance > 0 ? (1.0f / distance) * d : contact.normal;
+                separation = distance - a.radius - b->radius;
+            } else {
+                separation = rectSeparation(rects[contact.rect], a.position,
+                                            a.radius, normal);
+            }
+
+            float correction =
+                std::clamp(BAUMGARTE * (separation + LINEAR_SLOP),
+                           -MAX_LINEAR_CORRECTION, 0.0f);
+            float impulse = -correction / (a.invMass + invMassB);
+            a.position += (impulse * a.invMass) * normal;
+            if (b != nullptr) {
+                b->position -= (impulse * invMassB) * normal;
+            }
+        }
+    }
+}
+
+void GridPhysics::step(float dt) {
+    findContacts();
+
+    for (auto &circle : circles) {
+        if (circle.enabled) {
+            circle.velocity += (dt * circle.invMass) * circle.force;
+        }
+        circle.force.SetZero();
+    }
+
+    solveVelocities();
+
+    for (auto &circle : circles) {
+        if (!circle.enabled) {
+            continue;
+        }
+        b2Vec2 translation = dt * circle.velocity;
+        if (translation.LengthSquared() > MAX_TRANSLATION * MAX_TRANSLATION) {
+            circle.velocity *= MAX_TRANSLATION / translation.Length();
+            translation = dt * circle.velocity;
+        }
+        circle.position += translation;
+    }
+
+    if (geometry != nullptr) {
+        solvePositions();
+    }
+}
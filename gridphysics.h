@@ -0,0 +1,82 @@
+#pragma once
+
+#include <vector>
+
+#include <box2d/box2d.h>
+
+#include "physics.h"
+#include "tile.h"
+
+// A small deterministic backend that only knows about circles and the merged
+// rectangles of the static geometry. It follows the solver of Box2D closely
+// enough for the game, without broad phase, islands or contact caches, and
+// its results do not depend on anything but the inputs of each step.
+class GridPhysics : public PhysicsBackend {
+  public:
+    void init(StaticGeometry *geometry) override;
+    int addCircle(b2Vec2 position, float radius, IBody *owner) override;
+
+    b2Vec2 getPosition(int body) override { return circles[body].position; }
+    b2Vec2 getVelocity(int body) override { return circles[body].velocity; }
+    void setVelocity(int body, b2Vec2 velocity) override {
+        circles[body].velocity = velocity;
+    }
+    void applyForce(int body, b2Vec2 force) override {
+        circles[body].force += force;
+    }
+    void setTransform(int body, b2Vec2 position) override {
+        circles[body].position = position;
+    }
+    bool isEnabled(int body) override { return circles[body].enabled; }
+    void setEnabled(int body, bool enabled) override {
+        circles[body].enabled = enabled;
+        if (!enabled) {
+            circles[body].touching.clear();
+        }
+    }
+
+    // The circles keep nothing else between steps.
+    bool canRestore() override { return true; }
+    void saveContacts(std::vector<int> &contacts) override;
+    void loadContacts(const std::vector<int> &contacts) override;
+
+    void step(float dt) override;
+
+  protected:
+    struct Circle {
+        b2Vec2 position;
+        b2Vec2 velocity{0, 0};
+        b2Vec2 force{0, 0};
+        float radius;
+        float invMass;
+        bool enabled = true;
+        IBody *owner;
+        // What the circle touched in the last step: rectangle indices, or
+        // -1 - i for the circle i.
+        std::vector<int> touching;
+        std::vector<int> touchingNext;
+    };
+
+    struct Contact {
+        int a;
+        // Index of the other circle, or -1 for the rectangle rect.
+        int b;
+        int rect;
+        b2Vec2 normal;
+        float separation;
+        float normalImpulse;
+        float tangentImpulse;
+    };
+
+    StaticGeometry *geometry = nullptr;
+    std::vector<Circle> circles;
+
+    // Reused between steps.
+    std::vector<Contact> contacts;
+    std::vector<int> nearbyRects;
+
+    void findContacts();
+    void findRectContacts(int i);
+    void solveVelocities();
+    void solvePositions();
+};
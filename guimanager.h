@@ -2,38 +2,60 @@
 
 #include <QGraphicsScene>
 #include <QGraphicsTextItem>
+#include <QImage>
 #include <QKeyEvent>
 #include <QMap>
+#include <QStyleOptionGraphicsItem>
+#include <algorithm>
+#include <mutex>
 
 #include "config.h"
 #include "foodcontainer.h"
 #include "gamemanager.h"
+#include "metrics.h"
+#include "pixmapatlas.h"
+#include "rendersnapshot.h"
+#include "serialize.h"
 #include "tile.h"
 
+// The items only read render snapshots, never the game, which belongs to
+// the simulation thread.
 class GuiItem {
   public:
     GuiItem() {}
-    virtual void update() = 0;
+    virtual void update(const RenderSnapshot &snapshot) = 0;
     virtual QGraphicsItem *getGraphicsItem() = 0;
+    // Whether the tiles are large enough on screen for text and sprites.
+    virtual void setDetailed(bool) {}
 };
 
-class GuiFoodContainer : public GuiItem {
+// Tiles smaller than this many pixels on screen are drawn without details.
+constexpr float DETAIL_TILE_PIXELS = 12;
+
+class GuiFoodContainer {
   public:
-    GuiFoodContainer(ContainerHolder *foodContainer,
-                     QGraphicsItem *parentItem = nullptr)
-        : foodContainer(foodContainer) {
-        // Set text alignment to center
-        graphicsItem = new QGraphicsTextItem(parentItem);
+    GuiFoodContainer(QGraphicsItem *parentItem = nullptr) {
+        // Only holds the others.
+        graphicsItem = new QGraphicsRectItem(parentItem);
+        graphicsItem->setPen(Qt::NoPen);
         graphicsItem->setPos(0, -0.5 * SCALE);
-        picItem = new QGraphicsPixmapItem(graphicsItem);
+        textItem = new QGraphicsTextItem(graphicsItem);
+        picItem = new QGraphicsPixmapItem(textItem);
         picItem->setPos(0, 0.5 * SCALE);
-        progress = new QGraphicsRectItem(graphicsItem);
+        picItem->setVisible(false);
+        // Stands in for the rest when zoomed out, colored by the kind and
+        // the progress of the container.
+        glyph = new QGraphicsRectItem(0.2 * SCALE, 0.7 * SCALE, 0.6 * SCALE,
+                                      0.6 * SCALE, graphicsItem);
+        glyph->setPen(Qt::NoPen);
+        glyph->setVisible(false);
+        progress = new QGraphicsRectItem(textItem);
         progress->setPos(0, SCALE * 0.8);
         progress->setBrush(QBrush(Qt::green));
         progress->setPen(Qt::NoPen);
         progress->setZValue(1);
         progress->setVisible(false);
-        overcookProgress = new QGraphicsRectItem(graphicsItem);
+        overcookProgress = new QGraphicsRectItem(textItem);
         overcookProgress->setPos(0, SCALE * 0.8);
         overcookProgress->setBrush(QBrush(Qt::red));
         overcookProgress->setPen(Qt::NoPen);
@@ -41,279 +63,545 @@ class GuiFoodContainer : public GuiItem {
         overcookProgress->setVisible(false);
     }
 
-    void update() override {
-        if (foodContainer->isPropertyChanged()) {
-            if (foodContainer->getContainerKind() == ContainerKind::Plate) {
-                QPixmap image(":/img/images/Plate.png");
-                picItem->setPixmap(image.scaled(SCALE, SCALE));
-                picItem->setVisible(true);
-                graphicsItem->setPlainText(
-                    QString::fromStdString(foodContainer->toString()));
-            } else if (foodContainer->getContainerKind() ==
-                       ContainerKind::Pan) {
-                QPixmap image(":/img/images/Pan.PNG");
+    // Only touches the items whose look changed, so that the scene only
+    // repaints those.
+    void update(const ContainerSnapshot &container) {
+        if (container.version == shown.version) {
+            return;
+        }
+        if (container.text != shown.text) {
+            textItem->setPlainText(QString::fromStdString(container.text));
+        }
+        auto sprite = getContainerSprite(container.kind);
+        if (sprite != picSprite) {
+            picSprite = sprite;
+            if (sprite == Sprite::Plate) {
+                picItem->setPos(0, 0.5 * SCALE);
+            } else if (sprite == Sprite::Pan) {
                 picItem->setPos(-SCALE / 4, SCALE / 3);
-                picItem->setPixmap(image.scaled(SCALE * 1.5, SCALE * 1.5));
-                picItem->setVisible(true);
-                graphicsItem->setPlainText(
-                    QString::fromStdString(foodContainer->toString()));
-            } else if (foodContainer->getContainerKind() ==
-                       ContainerKind::Pot) {
-                QPixmap image(":/img/images/Pot.PNG");
+            } else if (sprite == Sprite::Pot) {
                 picItem->setPos(-SCALE / 2, 0);
-                picItem->setPixmap(image.scaled(SCALE * 2, SCALE * 2));
-                picItem->setVisible(true);
-                graphicsItem->setPlainText(
-                    QString::fromStdString(foodContainer->toString()));
-            } else {
-                graphicsItem->setPlainText(
-                    QString::fromStdString(foodContainer->toString()));
-                picItem->setVisible(false);
             }
-            if (foodContainer->isWorking()) {
-                progress->setVisible(true);
-                progress->setRect(0, 0, SCALE * foodContainer->getProgress(),
-                                  SCALE * 0.2);
-                overcookProgress->setVisible(true);
-                overcookProgress->setRect(
-                    0, 0, SCALE * foodContainer->getOvercookProgress(),
-                    SCALE * 0.2);
-            } else {
-                progress->setVisible(false);
-                overcookProgress->setVisible(false);
+            if (sprite != Sprite::None) {
+                picItem->setPixmap(PixmapAtlas::get(SCALE).getPixmap(sprite));
             }
+            picItem->setVisible(sprite != Sprite::None);
+        }
+        if (container.working != shown.working) {
+            progress->setVisible(container.working);
+            overcookProgress->setVisible(container.working);
+        }
+        if (container.progress != shown.progress) {
+            progress->setRect(0, 0, SCALE * container.progress, SCALE * 0.2);
+        }
+        if (container.overcookProgress != shown.overcookProgress) {
+            overcookProgress->setRect(0, 0, SCALE * container.overcookProgress,
+                                      SCALE * 0.2);
+        }
+        shown = container;
+        if (!detailed) {
+            updateGlyph();
         }
     }
 
-    QGraphicsItem *getGraphicsItem() override { return graphicsItem; }
+    void setDetailed(bool detailed) {
+        this->detailed = detailed;
+        textItem->setVisible(detailed);
+        if (detailed) {
+            glyph->setVisible(false);
+        } else {
+            updateGlyph();
+        }
+    }
+
+    QGraphicsItem *getGraphicsItem() { return graphicsItem; }
 
   protected:
-    ContainerHolder *foodContainer;
-    QGraphicsTextItem *graphicsItem;
+    // What the items show.
+    ContainerSnapshot shown;
+    Sprite picSprite = Sprite::None;
+    bool detailed = true;
+    QGraphicsRectItem *graphicsItem;
+    QGraphicsTextItem *textItem;
+    QGraphicsRectItem *glyph;
     QGraphicsRectItem *progress;
     QGraphicsRectItem *overcookProgress;
     QGraphicsPixmapItem *picItem;
+
+    void updateGlyph() {
+        QColor color;
+        switch (shown.kind) {
+        case ContainerKind::None:
+            glyph->setVisible(false);
+            return;
+        case ContainerKind::Plate:
+            color = QColor("#E0E0E0");
+            break;
+        case ContainerKind::DirtyPlates:
+            color = QColor("#8B5A2B");
+            break;
+        default:
+            color = QColor("#505050");
+            break;
+        }
+        if (shown.overcookProgress > 0) {
+            color = Qt::red;
+        } else if (shown.working) {
+            // From yellow to green as the recipe progresses.
+            color = QColor::fromHsvF(0.17 + 0.16 * shown.progress, 1, 0.9);
+        }
+        glyph->setBrush(color);
+        glyph->setVisible(true);
+    }
 };
 
 class GuiPlayer : public GuiItem {
   public:
-    GuiPlayer(Player *player) : player(player) {
+    GuiPlayer(int index) : index(index) {
         graphicsItem = new QGraphicsEllipseItem(0, 0, PLAYER_RADIUS * 2 * SCALE,
                                                 PLAYER_RADIUS * 2 * SCALE);
         graphicsItem->setZValue(10);
         graphicsItem->setBrush(QBrush(QColor("#0066FF")));
-        guiFoodContainer =
-            new GuiFoodContainer(player->getOnHand(), graphicsItem);
+        guiFoodContainer = new GuiFoodContainer(graphicsItem);
+        guiFoodContainer->getGraphicsItem()->setPos(-0.15f * SCALE, -SCALE);
     }
 
-    void update() override {
-        auto pos = player->getBody()->GetPosition();
-        graphicsItem->setPos((pos.x - PLAYER_RADIUS) * SCALE,
-                             (pos.y - PLAYER_RADIUS) * SCALE);
-        guiFoodContainer->update();
-        guiFoodContainer->getGraphicsItem()->setPos(-0.15f * SCALE, -SCALE);
-        graphicsItem->setVisible(player->getRespawnCountdown() == 0);
+    void update(const RenderSnapshot &snapshot) override {
+        auto &player = snapshot.players[index];
+        if (player.position != position) {
+            position = player.position;
+            graphicsItem->setPos((position.x - PLAYER_RADIUS) * SCALE,
+                                 (position.y - PLAYER_RADIUS) * SCALE);
+        }
+        guiFoodContainer->update(player.onHand);
+        if (player.visible != graphicsItem->isVisible()) {
+            graphicsItem->setVisible(player.visible);
+        }
+    }
+
+    void setDetailed(bool detailed) override {
+        guiFoodContainer->setDetailed(detailed);
     }
 
     QGraphicsItem *getGraphicsItem() override { return graphicsItem; }
 
   protected:
-    Player *player;
+    int index;
+    b2Vec2 position{-1, -1};
     QGraphicsEllipseItem *graphicsItem;
     GuiFoodContainer *guiFoodContainer;
 };
 
-class GuiTile : public GuiItem {
+// The static map, painted by a single item from the pixmap atlas rather
+// than by a few items per tile. Only the exposed tiles are painted, and
+// when the tiles get small on screen the map is drawn from an image with
+// one pixel per tile instead.
+class GuiTileLayer : public QGraphicsItem {
   public:
-    GuiTile(Tile *tile) : tile(tile) {
-        graphicsItem = new QGraphicsRectItem(0, 0, SCALE, SCALE);
-        graphicsItem->setPos(tile->getPos().x * SCALE,
-                             tile->getPos().y * SCALE);
-        auto kind = tile->getTileKind();
+    GuiTileLayer(const std::vector<Tile *> &mapTiles) {
+        for (auto tile : mapTiles) {
+            width = std::max(width, (int)tile->getPos().x + 1);
+            height = std::max(height, (int)tile->getPos().y + 1);
+        }
+        looks.assign(width * height, TileLook{TileKind::None, Sprite::None});
+        overview = QImage(std::max(width, 1), std::max(height, 1),
+                          QImage::Format_RGB32);
+        overview.fill(Qt::white);
+        for (auto tile : mapTiles) {
+            int x = tile->getPos().x, y = tile->getPos().y;
+            auto kind = tile->getTileKind();
+            auto sprite = getTileSprite(kind);
+            if (kind == TileKind::IngredientBox) {
+                auto pantry = static_cast<TileIngredientBox *>(tile);
+                sprite = getIngredientSprite(pantry->getIngredient());
+            }
+            looks[y * width + x] = TileLook{kind, sprite};
+            overview.setPixel(x, y, getOverviewColor(kind).rgb());
+        }
+        bounds = QRectF(-1, -1, width * SCALE + 2, height * SCALE + 2);
+        setFlag(ItemUsesExtendedStyleOption);
+    }
+
+    QRectF boundingRect() const override { return bounds; }
+
+    void paint(QPainter *painter, const QStyleOptionGraphicsItem *option,
+               QWidget *) override {
+        float lod =
+            option->levelOfDetailFromTransform(painter->worldTransform());
+        if (lod * SCALE < DETAIL_TILE_PIXELS) {
+            painter->drawImage(QRectF(0, 0, width * SCALE, height * SCALE),
+                               overview);
+            return;
+        }
+
+        auto exposed = option->exposedRect.adjusted(-1, -1, 1, 1);
+        int left = std::max(0, int(exposed.left() / SCALE));
+        int top = std::max(0, int(exposed.top() / SCALE));
+        int right = std::min(width - 1, int(exposed.right() / SCALE));
+        int bottom = std::min(height - 1, int(exposed.bottom() / SCALE));
+        auto &atlas = PixmapAtlas::get(SCALE);
+        // The outlines of the counters go over the ones of the floor.
+        for (int pass = 0; pass < 2; pass++) {
+            for (int y = top; y <= bottom; y++) {
+                for (int x = left; x <= right; x++) {
+                    auto &look = looks[y * width + x];
+                    if (look.kind == TileKind::None ||
+                        isGround(look.kind) != (pass == 0)) {
+                        continue;
+                    }
+                    paintTile(painter, atlas, x, y, look);
+                }
+            }
+        }
+    }
+
+  protected:
+    struct TileLook {
+        TileKind kind;
+        Sprite sprite;
+    };
+
+    int width = 0, height = 0;
+    // Indexed by y * width + x.
+    std::vector<TileLook> looks;
+    QImage overview;
+    QRectF bounds;
+
+    static bool isGround(TileKind kind) {
+        return kind == TileKind::Void || kind == TileKind::Floor;
+    }
+
+    static QColor getOverviewColor(TileKind kind) {
         switch (kind) {
         case TileKind::Void:
-            graphicsItem->setBrush(QBrush(Qt::white));
-            graphicsItem->setPen(Qt::NoPen);
-            graphicsItem->setZValue(0);
+            return Qt::white;
+        case TileKind::Floor:
+            return QColor("#FFFFCC");
+        case TileKind::Table:
+            return QColor("#99CC00");
+        case TileKind::ServiceWindow:
+            return QColor("#FFC0CB");
+        default:
+            return QColor("#808080");
+        }
+    }
+
+    void paintTile(QPainter *painter, PixmapAtlas &atlas, int x, int y,
+                   const TileLook &look) {
+        QRectF rect(x * SCALE, y * SCALE, SCALE, SCALE);
+        switch (look.kind) {
+        case TileKind::Void:
+            painter->setPen(Qt::NoPen);
+            painter->setBrush(Qt::white);
             break;
         case TileKind::Floor:
-            graphicsItem->setBrush(QBrush(QColor("#FFFFCC")));
-            graphicsItem->setPen(QPen(Qt::lightGray));
-            graphicsItem->setZValue(0);
+            painter->setPen(Qt::lightGray);
+            painter->setBrush(QColor("#FFFFCC"));
             break;
         case TileKind::Table:
-            graphicsItem->setBrush(QBrush(QColor("#99CC00")));
-            graphicsItem->setPen(QPen(Qt::black));
-            graphicsItem->setZValue(1);
+            painter->setPen(Qt::black);
+            painter->setBrush(QColor("#99CC00"));
             break;
         case TileKind::ServiceWindow:
-            graphicsItem->setBrush(QBrush(QColor("#FFC0CB")));
-            graphicsItem->setPen(QPen(Qt::black));
-            graphicsItem->setZValue(1);
+            painter->setPen(Qt::black);
+            painter->setBrush(QColor("#FFC0CB"));
             break;
         default:
-            graphicsItem->setPen(QPen(Qt::black));
-            graphicsItem->setZValue(1);
-            auto text =
-                new QGraphicsTextItem(QString(getAbbrev(kind)), graphicsItem);
-            auto pic = new QGraphicsPixmapItem(graphicsItem);
-            if (kind == TileKind::IngredientBox) {
-                auto pantry = static_cast<TileIngredientBox *>(tile);
-                std::string label = pantry->getIngredient();
-                if (label == "fish") {
-                    QPixmap image(":/img/images/fish.png");
-                    pic->setPixmap(image.scaled(SCALE, SCALE));
-                    pic->setPos(0, 0);
-                } else if (label == "kelp") {
-                    QPixmap image(":/img/images/kelp.png");
-                    pic->setPixmap(image.scaled(SCALE, SCALE));
-                    pic->setPos(0, 0);
-                } else if (label == "rice") {
-                    QPixmap image(":/img/images/rice.png");
-                    pic->setPixmap(image.scaled(SCALE, SCALE));
-                    pic->setPos(0, 0);
-                } else {
-                    assert(0);
-                }
-            } else if (kind == TileKind::ChoppingStation) {
-                QPixmap image(":/img/images/ChoppingStation.png");
-                pic->setPixmap(image.scaled(SCALE, SCALE));
-                pic->setPos(0, 0);
-            } else if (kind == TileKind::Stove) {
-                QPixmap image(":/img/images/Stove.png");
-                pic->setPixmap(image.scaled(SCALE, SCALE));
-                pic->setPos(0, 0);
-            } else if (kind == TileKind::Trashbin) {
-                QPixmap image(":/img/images/Trashbin.png");
-                pic->setPixmap(image.scaled(SCALE, SCALE));
-                pic->setPos(0, 0);
-            } else if (kind == TileKind::PlateReturn) {
-                QPixmap image(":/img/images/PlateReturn.png");
-                pic->setPixmap(image.scaled(SCALE, SCALE));
-                pic->setPos(0, 0);
-            } else if (kind == TileKind::Sink) {
-                QPixmap image(":/img/images/Sink.png");
-                pic->setPixmap(image.scaled(SCALE, SCALE));
-                pic->setPos(0, 0);
-            } else if (kind == TileKind::PlateRack) {
-                QPixmap image(":/img/images/PlateRack.png");
-                pic->setPixmap(image.scaled(SCALE, SCALE));
-                pic->setPos(0, 0);
-            } else if (kind == TileKind::ServiceWindow) {
-
-                text->setPos(0, 0.4 * SCALE);
-            }
+            painter->setPen(Qt::black);
+            painter->setBrush(Qt::NoBrush);
+            break;
         }
-        auto foodContainer = tile->getContainer();
-        if (foodContainer != nullptr) {
-            guiFoodContainer =
-                new GuiFoodContainer(foodContainer, graphicsItem);
+        painter->drawRect(rect);
+        if (!isGround(look.kind) && look.kind != TileKind::Table &&
+            look.kind != TileKind::ServiceWindow) {
+            // Where a QGraphicsTextItem would put it.
+            painter->drawText(rect.adjusted(4, 4, 0, 0),
+                              Qt::AlignLeft | Qt::AlignTop,
+                              QString(getAbbrev(look.kind)));
         }
+        if (look.sprite != Sprite::None) {
+            atlas.draw(painter, look.sprite, rect.topLeft());
+        }
+    }
+};
+
+// The container on a tile, drawn above the tile layer.
+class GuiTile : public GuiItem {
+  public:
+    // containerIndex is the index of the tile in
+    // GameManager::getContainerTiles().
+    GuiTile(Tile *tile, int containerIndex) : containerIndex(containerIndex) {
+        guiFoodContainer = new GuiFoodContainer();
+        graphicsItem = guiFoodContainer->getGraphicsItem();
+        graphicsItem->setPos(tile->getPos().x * SCALE,
+                             (tile->getPos().y - 0.5) * SCALE);
+        graphicsItem->setZValue(2);
+    }
+
+    void update(const RenderSnapshot &snapshot) override {
+        guiFoodContainer->update(snapshot.tileContainers[containerIndex]);
     }
 
-    void update() override {
-        if (guiFoodContainer != nullptr)
-            guiFoodContainer->update();
+    void setDetailed(bool detailed) override {
+        guiFoodContainer->setDetailed(detailed);
     }
 
     QGraphicsItem *getGraphicsItem() override { return graphicsItem; }
 
   protected:
-    Tile *tile;
-    QGraphicsRectItem *graphicsItem;
-    GuiFoodContainer *guiFoodContainer = nullptr;
+    int containerIndex;
+    QGraphicsItem *graphicsItem;
+    GuiFoodContainer *guiFoodContainer;
 };
 
+// The order panel sits left of the map.
+constexpr float ORDER_PANEL_WIDTH = 150;
+
 class GuiOrder : public GuiItem {
   public:
-    GuiOrder(OrderManager *orderManager) : orderManager(orderManager) {
+    GuiOrder() {
         graphicsItem = new QGraphicsTextItem();
-        graphicsItem->setPos(-150, 0);
+        graphicsItem->setPos(-ORDER_PANEL_WIDTH, 0);
     }
 
-    void update() override {
-        std::stringstream ss;
-        ss << "Frame: " << orderManager->getFrame() << "/"
-           << orderManager->getFrame() + orderManager->getTimeCountdown()
-           << '\n';
-        ss << "Fund: " << orderManager->getFund() << '\n';
-        for (auto &order : orderManager->getOrders()) {
-            ss << order.countdown << ' ' << order.price << ' '
-               << order.mixture.toString();
-            ss << '\n';
+    void update(const RenderSnapshot &snapshot) override {
+        text.clear();
+        text += "Frame: ";
+        appendNumber(text, snapshot.frame);
+        text += '/';
+        appendNumber(text, snapshot.totalFrames);
+        text += "\nFund: ";
+        appendNumber(text, snapshot.fund);
+        text += '\n';
+        for (auto &order : snapshot.orders) {
+            appendNumber(text, order.countdown);
+            text += ' ';
+            appendNumber(text, order.price);
+            text += ' ';
+            text += order.mixture;
+            text += '\n';
+        }
+        if (text != shown) {
+            shown.swap(text);
+            graphicsItem->setPlainText(QString::fromStdString(shown));
         }
-        graphicsItem->setPlainText(QString::fromStdString(ss.str()));
     }
 
     QGraphicsItem *getGraphicsItem() override { return graphicsItem; }
 
   protected:
-    OrderManager *orderManager;
     QGraphicsTextItem *graphicsItem;
+    // Reused between frames.
+    std::string text, shown;
+};
+
+// Rolling graphs of the performance metrics, drawn over the map.
+class GuiHud : public QGraphicsItem {
+  public:
+    static constexpr int WIDTH = Metrics::HISTORY;
+    static constexpr int ROW_HEIGHT = 40;
+    static constexpr int HEIGHT = ROW_HEIGHT * METRIC_COUNT + 20;
+
+    GuiHud(Metrics *metrics) : metrics(metrics) {
+        setZValue(100);
+        // Readable at any zoom.
+        setFlag(ItemIgnoresTransformations);
+        setVisible(false);
+    }
+
+    QRectF boundingRect() const override {
+        return QRectF(0, 0, WIDTH, HEIGHT);
+    }
+
+    void paint(QPainter *painter, const QStyleOptionGraphicsItem *,
+               QWidget *) override {
+        static const char *names[METRIC_COUNT] = {"Step ms", "Agent ms",
+                                                  "Render ms", "FPS"};
+        painter->fillRect(boundingRect(), QColor(0, 0, 0, 160));
+        for (int i = 0; i < METRIC_COUNT; i++) {
+            metrics->read(Metric(i), samples);
+            float top = 0;
+            for (auto sample : samples) {
+                top = std::max(top, sample);
+            }
+            float bottom = (i + 1) * ROW_HEIGHT - 2;
+            float scale = top > 0 ? (ROW_HEIGHT - 14) / top : 0;
+            points.resize(samples.size());
+            for (int j = 0; j < int(samples.size()); j++) {
+                points[j] = QPointF(j, bottom - samples[j] * scale);
+            }
+            painter->setPen(Qt::green);
+            painter->drawPolyline(points.data(), points.size());
+            painter->setPen(Qt::white);
+            painter->drawText(
+                QPointF(4, i * ROW_HEIGHT + 12),
+                QString("%1: %2, max %3")
+                    .arg(names[i])
+                    .arg(samples.empty() ? 0 : samples.back(), 0, 'f', 2)
+                    .arg(top, 0, 'f', 2));
+        }
+        painter->drawText(QPointF(4, HEIGHT - 6),
+                          QString("Timeouts: %1, mismatches: %2")
+                              .arg(metrics->getCount(Counter::Timeouts))
+                              .arg(metrics->getCount(Counter::Mismatches)));
+    }
+
+  protected:
+    Metrics *metrics;
+    // Reused between paints.
+    std::vector<float> samples;
+    std::vector<QPointF> points;
 };
 
 class GuiManager final : public QGraphicsScene {
     Q_OBJECT
 
   public:
-    GuiManager(GameManager *gameManager) : gameManager(gameManager) {}
+    GuiManager(GameManager *gameManager) : gameManager(gameManager) {
+        // Lets the view find the few items in sight on large maps.
+        setItemIndexMethod(BspTreeIndex);
+    }
     ~GuiManager() {}
     GuiManager(const GuiManager &) = delete;
     GuiManager &operator=(const GuiManager &) = delete;
 
+    // Only reads the layout of the level, so it must run before the
+    // simulation thread starts.
     void init() {
-        for (auto &player : gameManager->getPlayers()) {
-            auto guiPlayer = new GuiPlayer(player);
+        int playerCount = gameManager->getPlayers().size();
+        for (int i = 0; i < playerCount; i++) {
+            auto guiPlayer = new GuiPlayer(i);
             addItem(guiPlayer->getGraphicsItem());
             guiItems.push_back(guiPlayer);
         }
-        for (auto &tile : gameManager->getTiles()) {
-            auto guiTile = new GuiTile(tile);
+        tileLayer = new GuiTileLayer(gameManager->getTiles());
+        addItem(tileLayer);
+        auto &containerTiles = gameManager->getContainerTiles();
+        for (int i = 0; i < int(containerTiles.size()); i++) {
+            auto guiTile = new GuiTile(containerTiles[i], i);
             addItem(guiTile->getGraphicsItem());
             guiItems.push_back(guiTile);
         }
-        auto guiOrder = new GuiOrder(&gameManager->orderManager);
+        auto guiOrder = new GuiOrder();
         addItem(guiOrder->getGraphicsItem());
         guiItems.push_back(guiOrder);
     }
 
-    void step() { clearKeys(); }
+    // The items only change what differs from the snapshot they showed
+    // before, and the scene repaints just the regions of those items.
+    void updateItem(const RenderSnapshot &snapshot) {
+        for (auto &guiItem : guiItems) {
+            guiItem->update(snapshot);
+        }
+        if (hud != nullptr && hud->isVisible()) {
+            hud->update();
+        }
+    }
 
-  public slots:
-    void updateItem() {
+    // The HUD is toggled with F3 and only measures while it is shown.
+    void setMetrics(Metrics *metrics) {
+        this->metrics = metrics;
+        hud = new GuiHud(metrics);
+        addItem(hud);
+    }
+    void toggleHud() {
+        if (hud == nullptr) {
+            return;
+        }
+        hud->setVisible(!hud->isVisible());
+        metrics->setEnabled(hud->isVisible());
+    }
+
+    void setDetailed(bool detailed) {
+        if (detailed == this->detailed) {
+            return;
+        }
+        this->detailed = detailed;
         for (auto &guiItem : guiItems) {
-            guiItem->update();
+            guiItem->setDetailed(detailed);
         }
-        this->update();
+    }
+
+    // The area drawn for a frame: the map with the containers sticking out
+    // above its top row, and the order panel on its left.
+    QRect getFrameRect() {
+        auto map = tileLayer->boundingRect();
+        QRectF rect(QPointF(-ORDER_PANEL_WIDTH, -SCALE), map.bottomRight());
+        return rect.toAlignedRect();
     }
 
   private:
     GameManager *gameManager;
     std::vector<GuiItem *> guiItems;
+    GuiTileLayer *tileLayer = nullptr;
+    bool detailed = true;
+    Metrics *metrics = nullptr;
+    GuiHud *hud = nullptr;
+    Metrics::Clock::time_point paintStart;
+
+    // Every paint of the scene starts with the background and ends with
+    // the foreground.
+    void drawBackground(QPainter *painter, const QRectF &rect) override {
+        if (metrics != nullptr && metrics->isEnabled()) {
+            paintStart = Metrics::Clock::now();
+        }
+        QGraphicsScene::drawBackground(painter, rect);
+    }
+    void drawForeground(QPainter *painter, const QRectF &rect) override {
+        QGraphicsScene::drawForeground(painter, rect);
+        if (metrics != nullptr && metrics->isEnabled()) {
+            metrics->recordSince(Metric::RenderTime, paintStart);
+        }
+    }
 
   public:
-    bool getKey(Qt::Key key) { return keyTable[key]; }
-    bool getKeyDown(Qt::Key key) { return keyDownTable[key]; }
-    bool getKeyUp(Qt::Key key) { return keyUpTable[key]; }
+    // Read by the simulation thread while the UI thread records the keys.
+    bool getKey(Qt::Key key) {
+        std::lock_guard<std::mutex> lk(keyMutex);
+        return keyTable.value(key);
+    }
+    bool getKeyDown(Qt::Key key) {
+        std::lock_guard<std::mutex> lk(keyMutex);
+        return keyDownTable.value(key);
+    }
+    bool getKeyUp(Qt::Key key) {
+        std::lock_guard<std::mutex> lk(keyMutex);
+        return keyUpTable.value(key);
+    }
     void clearKeys() {
+        std::lock_guard<std::mutex> lk(keyMutex);
         keyDownTable.clear();
         keyUpTable.clear();
     }
 
   private:
+    std::mutex keyMutex;
     QMap<int, bool> keyTable, keyDownTable, keyUpTable;
     void keyPressEvent(QKeyEvent *ev) override {
         if (ev->isAutoRepeat())
             return;
-        keyTable[ev->key()] = true;
-        keyDownTable[ev->key()] = true;
+        if (ev->key() == Qt::Key_F3) {
+            toggleHud();
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lk(keyMutex);
+            keyTable[ev->key()] = true;
+            keyDownTable[ev->key()] = true;
+        }
         QGraphicsScene::keyPressEvent(ev);
+        // Keep the view from scrolling with the keys of the players.
+        ev->accept();
     }
     void keyReleaseEvent(QKeyEvent *ev) override {
         if (ev->isAutoRepeat())
             return;
-        keyTable[ev->key()] = false;
-        keyUpTable[ev->key()] = true;
+        {
+            std::lock_guard<std::mutex> lk(keyMutex);
+            keyTable[ev->key()] = false;
+            keyUpTable[ev->key()] = true;
+        }
         QGraphicsScene::keyReleaseEvent(ev);
+        ev->accept();
     }
 };
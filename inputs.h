@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cassert>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gamemanager.h"
+
+// The inputs of the agent protocol, one per player: "Move <direction>",
+// "Interact <direction>" or "PutOrPick <direction>".
+
+inline std::pair<int, int> parseDirection(std::string direction) {
+    int x = 0;
+    int y = 0;
+    for (auto c : direction) {
+        switch (c) {
+        case 'L':
+            x -= 1;
+            break;
+        case 'R':
+            x += 1;
+            break;
+        case 'U':
+            y -= 1;
+            break;
+        case 'D':
+            y += 1;
+            break;
+        }
+    }
+    if (x < -1)
+        x = -1;
+    if (x > 1)
+        x = 1;
+    if (y < -1)
+        y = -1;
+    if (y > 1)
+        y = 1;
+    return {x, y};
+}
+
+inline void applyInputs(GameManager *gameManager,
+                        const std::vector<std::string> &inputs) {
+    assert(inputs.size() == gameManager->getPlayers().size());
+    for (int i = 0; i < inputs.size(); i++) {
+        auto &input = inputs[i];
+        auto &player = gameManager->getPlayers()[i];
+        if (input.starts_with("Move")) {
+            auto direction = input.substr(4);
+            auto [x, y] = parseDirection(direction);
+            gameManager->move(i, b2Vec2(x, y));
+        } else if (input.starts_with("Interact")) {
+            auto direction = input.substr(8);
+            auto [x, y] = parseDirection(direction);
+            x += player->getPosition().x;
+            y += player->getPosition().y;
+            gameManager->interact(i, x, y);
+        } else if (input.starts_with("PutOrPick")) {
+            auto direction = input.substr(9);
+            auto [x, y] = parseDirection(direction);
+            x += player->getPosition().x;
+            y += player->getPosition().y;
+            gameManager->putOrPick(i, x, y);
+        }
+    }
+}
@@ -1,13 +1,35 @@
 #pragma once
 
+#include <cstdint>
+#include <limits>
+
 #include <box2d/box2d.h>
 
 class IUpdatable {
   public:
     virtual void update() {}
     virtual void lateUpdate() {}
+
+    // How many of the next frames are known to change nothing but
+    // countdowns, assuming that no input arrives. skipFrames() advances
+    // through at most that many frames at once.
+    virtual int getIdleFrames() { return std::numeric_limits<int>::max(); }
+    virtual void skipFrames(int frames) {}
+
+    // Whether update() and lateUpdate() will do nothing until the object is
+    // woken up by GameManager. Asked at the end of every frame.
+    virtual bool canSleep() { return false; }
+    bool isAwake() { return awake; }
+
+  protected:
+    friend class GameManager;
+    bool awake = true;
 };
 
+// Collision filter categories of the fixtures.
+constexpr uint16_t PLAYER_CATEGORY = 0x0001;
+constexpr uint16_t WALL_CATEGORY = 0x0002;
+
 enum class BodyKind {
     Unknown,
     Player,
@@ -16,15 +38,11 @@ enum class BodyKind {
 
 class IBody {
   public:
-    b2Body *getBody() { return body; }
     BodyKind getBodyKind() { return bodyKind; }
 
+    // Called by the physics backend when this body starts touching another.
+    virtual void collision(IBody *entity) {}
+
   protected:
-    b2Body *body = nullptr;
     BodyKind bodyKind = BodyKind::Unknown;
-
-    void setUserData(BodyKind kind) {
-        bodyKind = kind;
-        body->GetUserData().pointer = reinterpret_cast<uintptr_t>(this);
-    }
 };
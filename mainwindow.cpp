@@ -13,10 +13,8 @@ MainWindow::MainWindow(QWidget *parent)
     gameManager = new GameManager();
     guiManager = new GuiManager(gameManager);
     guiManager->setParent(this);
-    auto view = new QGraphicsView(guiManager, this);
-    view->setFrameStyle(QFrame::NoFrame);
-    view->resize(this->size());
-    view->setSceneRect(QRect(0, 0, 400, 400));
+    view = new GameView(guiManager, this);
+    setCentralWidget(view);
 }
 
 MainWindow::~MainWindow() { delete ui; }
@@ -1,17 +1,34 @@
 #ifndef MAINWINDOW_H_
 #define MAINWINDOW_H_
 
+#include <QFile>
 #include <QGraphicsScene>
 #include <QGraphicsView>
+#include <QGuiApplication>
+#include <QLabel>
 #include <QMainWindow>
+#include <QScreen>
+#include <QSignalBlocker>
+#include <QSlider>
 #include <QThread>
 #include <QTimer>
+#include <QToolBar>
+#include <atomic>
 #include <fstream>
+#include <memory>
 
 #include "./ui_mainwindow.h"
+#include "botcontroller.h"
 #include "controller.h"
+#include "framescheduler.h"
+#include "gameview.h"
 #include "guimanager.h"
+#include "inputs.h"
 #include "mygetopt.h"
+#include "rendersnapshot.h"
+#include "replay.h"
+#include "replayplayer.h"
+#include "triplebuffer.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui {
@@ -101,8 +118,17 @@ class MainWindow : public QMainWindow {
         const char *levelFile = "level1.txt";
         const char *program = nullptr;
         bool printStderrToConsole = false;
+        TimingMode timingMode = TimingMode::Lockstep;
+        int timeBank = -1;
+        PhysicsKind physicsKind = PhysicsKind::Box2D;
+        bool fixedPoint = false;
+        bool physicsGiven = false;
+        bool fixedPointGiven = false;
+        const char *replayPath = nullptr;
+        // The seats of the agent or the keyboard. The bot plays the others.
+        int seats = -1;
         int o;
-        while ((o = getopt(argc, argv, "l:p:c")) != -1) {
+        while ((o = getopt(argc, argv, "l:p:crb:P:xR:dn:")) != -1) {
             switch (o) {
             case 'l':
                 levelFile = optarg;
@@ -113,116 +139,319 @@ class MainWindow : public QMainWindow {
             case 'c':
                 printStderrToConsole = true;
                 break;
+            case 'r':
+                timingMode = TimingMode::Realtime;
+                break;
+            case 'b':
+                timeBank = atoi(optarg);
+                break;
+            case 'P':
+                physicsKind = getPhysicsKind(optarg);
+                physicsGiven = true;
+                break;
+            case 'x':
+                fixedPoint = true;
+                fixedPointGiven = true;
+                break;
+            case 'R':
+                replayPath = optarg;
+                break;
+            case 'd':
+                scheduler.setPolicy(LatePolicy::Drop);
+                break;
+            case 'n':
+                seats = atoi(optarg);
+                break;
             default:
                 printf("Unknown commandline argument %c\n", o);
                 break;
             }
         }
 
+        if (replayPath != nullptr) {
+            openReplay(replayPath);
+            levelFile = replayIndex->getLevel().c_str();
+            // Replays that do not say are taken to be grid, the only physics
+            // the viewer can seek in.
+            if (!physicsGiven) {
+                physicsKind = PhysicsKind::Grid;
+            }
+            useReplayPhysics(*replayIndex, physicsKind, physicsGiven,
+                             fixedPoint, fixedPointGiven);
+        }
+        gameManager->setPhysicsKind(physicsKind);
+        gameManager->setFixedPoint(fixedPoint);
         gameManager->loadLevel(levelFile);
+        if (replayIndex != nullptr && !gameManager->canRestore()) {
+            throw std::runtime_error(
+                "The viewer only plays replays recorded with -P grid, since "
+                "the others cannot be seeked in; use render for them");
+        }
         guiManager->init();
+        guiManager->setMetrics(&metrics);
+        view->setSceneRect(guiManager->getFrameRect());
 
-        if (program != nullptr) {
+        // An agent plays every seat and the keyboard two, unless told.
+        int playerCount = gameManager->getPlayers().size();
+        if (seats < 0) {
+            seats = program != nullptr ? playerCount : 2;
+        }
+        seats = std::min(seats, playerCount);
+
+        if (replayIndex != nullptr) {
+            replayPlayer = std::make_unique<ReplayPlayer>(
+                gameManager, replayIndex.get(),
+                [this](const std::vector<std::string> &inputs) {
+                    simulate(inputs);
+                });
+            createReplayControls();
+            // Speed is set by the number of frames per tick.
+            scheduler.setPolicy(LatePolicy::Drop);
+        } else if (seats == 0) {
+            // The bot plays alone.
+        } else if (program != nullptr) {
             auto cli = new CliController(gameManager, program);
+            cli->setMetrics(&metrics);
             cli->setPrintStderrToConsole(printStderrToConsole);
+            cli->setTimingMode(timingMode);
+            if (timeBank >= 0) {
+                cli->setTimeBank(std::chrono::milliseconds(timeBank));
+            }
             controller = cli;
         } else {
             controller = new GuiController(gameManager, guiManager);
         }
-        controller->init(levelFile);
-        guiManager->updateItem();
+        if (controller != nullptr) {
+            controller->init(levelFile);
+        }
+        if (replayIndex == nullptr && seats < playerCount) {
+            bot = std::make_unique<BotController>(gameManager, seats);
+            bot->init(levelFile);
+        }
+        snapshots.getBack().capture(gameManager);
+        snapshots.publish();
+        drawSnapshot();
 
-        auto t = QThread::create([&]() {
-            auto lastTime = std::chrono::system_clock::now();
-            while (true) {
-                if (gameManager->orderManager.getTimeCountdown() <= 0) {
-                    break;
-                }
-                emit onInput(controller->requestInputs());
-                auto now = std::chrono::system_clock::now();
-                auto duration =
-                    std::chrono::duration_cast<std::chrono::milliseconds>(
-                        now - lastTime);
-                lastTime = now;
-                if (duration.count() < 1000.0f / FPS) {
-                    QThread::msleep(1000.0f / FPS - duration.count());
-                }
+        // From here on the game belongs to the simulation thread, which
+        // publishes a snapshot of every frame. The UI draws the latest one
+        // at the refresh rate of the screen, whatever the game runs at.
+        auto drawTimer = new QTimer(this);
+        connect(drawTimer, &QTimer::timeout, this, &MainWindow::drawSnapshot);
+        int interval = 1000.0 / QGuiApplication::primaryScreen()->refreshRate();
+        drawTimer->start(std::max(interval, 1));
+
+        running = true;
+        simulation = QThread::create([this]() {
+            if (replayPlayer != nullptr) {
+                playReplay();
+            } else {
+                playLive();
             }
         });
-        t->start();
-        connect(this, &MainWindow::onInput, this, &MainWindow::step,
-                Qt::BlockingQueuedConnection);
+        simulation->start();
     }
 
-    void closeEvent(QCloseEvent *event) override { delete controller; }
+    void closeEvent(QCloseEvent *event) override {
+        running = false;
+        if (simulation != nullptr) {
+            simulation->wait();
+        }
+        delete controller;
+        controller = nullptr;
+        QMainWindow::closeEvent(event);
+    }
 
-    std::pair<int, int> parseDirection(std::string direction) {
-        int x = 0;
-        int y = 0;
-        for (auto c : direction) {
-            switch (c) {
-            case 'L':
-                x -= 1;
-                break;
-            case 'R':
-                x += 1;
-                break;
-            case 'U':
-                y -= 1;
-                break;
-            case 'D':
-                y += 1;
+    // The loops of the simulation thread.
+    void playLive() {
+        scheduler.start();
+        while (running) {
+            if (gameManager->orderManager.getTimeCountdown() <= 0) {
                 break;
             }
+            std::vector<std::string> inputs;
+            if (controller != nullptr) {
+                inputs = controller->requestInputs();
+            } else {
+                inputs.assign(gameManager->getPlayers().size(), "Move");
+            }
+            if (bot != nullptr) {
+                bot->decide();
+                bot->fillInputs(inputs);
+            }
+            simulate(inputs);
+            snapshots.getBack().capture(gameManager);
+            snapshots.publish();
+            scheduler.wait();
+            recordFps();
         }
-        if (x < -1)
-            x = -1;
-        if (x > 1)
-            x = 1;
-        if (y < -1)
-            y = -1;
-        if (y > 1)
-            y = 1;
-        return {x, y};
     }
 
-  signals:
-    void onInput(std::vector<std::string> inputs);
+    // Plays the replay at the chosen speed. Faster than real time, several
+    // frames are simulated per tick and only the last one is captured,
+    // since the screen could not show the others anyway. The rest of each
+    // tick goes into the keyframes that seeks start from.
+    void playReplay() {
+        scheduler.start();
+        float budget = 0;
+        while (running) {
+            int target = seekTarget.exchange(-1);
+            bool changed = false;
+            if (target >= 0) {
+                replayPlayer->seek(target);
+                budget = 0;
+                changed = true;
+            } else if (!paused && !replayPlayer->isFinished()) {
+                budget += REPLAY_SPEEDS[speedIndex];
+                for (; budget >= 1 && !replayPlayer->isFinished(); budget--) {
+                    replayPlayer->step();
+                    changed = true;
+                }
+            }
+            if (changed) {
+                snapshots.getBack().capture(gameManager);
+                snapshots.publish();
+            }
+            replayPlayer->buildKeyframes(ReplayPlayer::KEYFRAME_INTERVAL);
+            scheduler.wait();
+            recordFps();
+        }
+    }
+
+    // Runs on the simulation thread.
+    void simulate(const std::vector<std::string> &inputs) {
+        applyInputs(gameManager, inputs);
+        if (metrics.isEnabled()) {
+            auto start = Metrics::Clock::now();
+            gameManager->step();
+            metrics.recordSince(Metric::StepTime, start);
+        } else {
+            gameManager->step();
+        }
+        guiManager->clearKeys();
+    }
+
+    void recordFps() {
+        auto now = Metrics::Clock::now();
+        if (metrics.isEnabled()) {
+            std::chrono::duration<float> elapsed = now - lastTick;
+            metrics.record(Metric::Fps, 1 / elapsed.count());
+        }
+        lastTick = now;
+    }
 
   public slots:
-    void step(std::vector<std::string> inputs) {
-        assert(inputs.size() == gameManager->getPlayers().size());
-        for (int i = 0; i < inputs.size(); i++) {
-            auto &input = inputs[i];
-            auto &player = gameManager->getPlayers()[i];
-            if (input.starts_with("Move")) {
-                auto direction = input.substr(4);
-                auto [x, y] = parseDirection(direction);
-                gameManager->move(i, b2Vec2(float(x), float(y)));
-            } else if (input.starts_with("Interact")) {
-                auto direction = input.substr(8);
-                auto [x, y] = parseDirection(direction);
-                x += (int)player->getBody()->GetPosition().x;
-                y += (int)player->getBody()->GetPosition().y;
-                gameManager->interact(i, x, y);
-            } else if (input.starts_with("PutOrPick")) {
-                auto direction = input.substr(9);
-                auto [x, y] = parseDirection(direction);
-                x += (int)player->getBody()->GetPosition().x;
-                y += (int)player->getBody()->GetPosition().y;
-                gameManager->putOrPick(i, x, y);
-            }
-        }
-        gameManager->step();
-        guiManager->step();
-        guiManager->updateItem();
+    void drawSnapshot() {
+        if (!snapshots.update()) {
+            return;
+        }
+        auto &snapshot = snapshots.getFront();
+        guiManager->updateItem(snapshot);
+        float fps = scheduler.getActualFps();
+        if (fps != shownFps) {
+            shownFps = fps;
+            setWindowTitle(QString("QtOvercooked - %1 / %2 FPS")
+                               .arg(fps, 0, 'f', 1)
+                               .arg(scheduler.getTargetFps()));
+        }
+        shownFrame = snapshot.frame;
+        if (timeline != nullptr && !timeline->isSliderDown()) {
+            QSignalBlocker blocker(timeline);
+            timeline->setValue(shownFrame);
+        }
     }
 
   private:
+    static constexpr float REPLAY_SPEEDS[] = {0.25, 0.5, 1,  2, 4,
+                                              8,    16,  32, 64};
+    static constexpr int NORMAL_SPEED = 2;
+
+    // The replay is read from the mapped file, which stays open.
+    void openReplay(const char *path) {
+        replayFile.setFileName(path);
+        if (!replayFile.open(QIODevice::ReadOnly)) {
+            throw std::runtime_error(std::string("Cannot open replay ") +
+                                     path);
+        }
+        auto data = replayFile.map(0, replayFile.size());
+        if (data == nullptr) {
+            throw std::runtime_error(std::string("Cannot map replay ") +
+                                     path);
+        }
+        replayIndex = std::make_unique<ReplayIndex>(
+            reinterpret_cast<const char *>(data), replayFile.size());
+    }
+
+    void createReplayControls() {
+        auto toolBar = new QToolBar("Replay", this);
+        addToolBar(Qt::BottomToolBarArea, toolBar);
+        auto slower =
+            toolBar->addAction("Slower", [this]() { changeSpeed(-1); });
+        slower->setShortcut(QKeySequence(Qt::Key_Minus));
+        auto back = toolBar->addAction("<", [this]() { stepReplay(-1); });
+        back->setShortcut(QKeySequence(Qt::Key_Left));
+        pauseAction =
+            toolBar->addAction("Pause", [this]() { setPaused(!paused); });
+        pauseAction->setShortcut(QKeySequence(Qt::Key_Space));
+        auto forward = toolBar->addAction(">", [this]() { stepReplay(1); });
+        forward->setShortcut(QKeySequence(Qt::Key_Right));
+        auto faster =
+            toolBar->addAction("Faster", [this]() { changeSpeed(1); });
+        faster->setShortcut(QKeySequence(Qt::Key_Plus));
+        speedLabel = new QLabel("1x");
+        speedLabel->setMinimumWidth(40);
+        toolBar->addWidget(speedLabel);
+        timeline = new QSlider(Qt::Horizontal);
+        timeline->setRange(0, replayIndex->getFrameCount());
+        toolBar->addWidget(timeline);
+        connect(timeline, &QSlider::valueChanged, this,
+                [this](int frame) { seekTarget = frame; });
+    }
+
+    void changeSpeed(int delta) {
+        int count = sizeof(REPLAY_SPEEDS) / sizeof(REPLAY_SPEEDS[0]);
+        speedIndex = std::clamp(speedIndex + delta, 0, count - 1);
+        speedLabel->setText(QString::number(REPLAY_SPEEDS[speedIndex]) + "x");
+    }
+
+    void setPaused(bool value) {
+        paused = value;
+        pauseAction->setText(value ? "Play" : "Pause");
+    }
+
+    // Frame stepping pauses the replay.
+    void stepReplay(int delta) {
+        setPaused(true);
+        seekTarget = std::clamp(shownFrame + delta, 0,
+                                replayIndex->getFrameCount());
+    }
+
     Ui::MainWindow *ui;
     GuiManager *guiManager;
+    GameView *view;
     GameManager *gameManager;
-    Controller *controller;
+    Controller *controller = nullptr;
+    std::unique_ptr<BotController> bot;
+    TripleBuffer<RenderSnapshot> snapshots;
+    QThread *simulation = nullptr;
+    std::atomic<bool> running = false;
+
+    QFile replayFile;
+    std::unique_ptr<ReplayIndex> replayIndex;
+    std::unique_ptr<ReplayPlayer> replayPlayer;
+    // Set by the controls, taken by the simulation thread.
+    std::atomic<int> seekTarget = -1;
+    std::atomic<bool> paused = false;
+    std::atomic<int> speedIndex = NORMAL_SPEED;
+    // Paces the simulation thread.
+    FrameScheduler scheduler;
+    Metrics metrics;
+    Metrics::Clock::time_point lastTick;
+    float shownFps = 0;
+    // The frame of the snapshot on screen.
+    int shownFrame = 0;
+    QAction *pauseAction = nullptr;
+    QSlider *timeline = nullptr;
+    QLabel *speedLabel = nullptr;
 
   signals:
     void updated();
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+enum class Metric {
+    // Milliseconds per GameManager::step.
+    StepTime,
+    // Milliseconds from a request to the response of the agent.
+    AgentLatency,
+    // Milliseconds to paint the scene.
+    RenderTime,
+    // Frames per second of the simulation loop.
+    Fps,
+};
+constexpr int METRIC_COUNT = int(Metric::Fps) + 1;
+
+enum class Counter {
+    Timeouts,
+    Mismatches,
+};
+constexpr int COUNTER_COUNT = int(Counter::Mismatches) + 1;
+
+// Rolling samples of the metrics of the last frames, shared by the threads
+// that measure them and the HUD that shows them. Samples are only taken
+// while enabled, and callers check isEnabled() before they even read the
+// clock, so a hidden HUD costs one relaxed load per measurement. The rare
+// events are always counted.
+//
+// Each metric has a single writer. The reader may see a sample being
+// replaced by a newer one, which does not matter for a graph.
+class Metrics {
+  public:
+    static constexpr int HISTORY = 240;
+
+    using Clock = std::chrono::steady_clock;
+
+    void setEnabled(bool value) { enabled.store(value); }
+    bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+
+    void record(Metric metric, float value) {
+        if (!isEnabled()) {
+            return;
+        }
+        auto &series = this->series[int(metric)];
+        int head = series.head.load(std::memory_order_relaxed);
+        series.samples[head % HISTORY].store(value, std::memory_order_relaxed);
+        series.head.store(head + 1, std::memory_order_release);
+    }
+    // Records the milliseconds since start.
+    void recordSince(Metric metric, Clock::time_point start) {
+        std::chrono::duration<float, std::milli> elapsed = Clock::now() - start;
+        record(metric, elapsed.count());
+    }
+
+    void count(Counter counter) {
+        counters[int(counter)].fetch_add(1, std::memory_order_relaxed);
+    }
+    int getCount(Counter counter) {
+        return counters[int(counter)].load(std::memory_order_relaxed);
+    }
+
+    // The samples of a metric, oldest first.
+    void read(Metric metric, std::vector<float> &out) {
+        auto &series = this->series[int(metric)];
+        int head = series.head.load(std::memory_order_acquire);
+        int n = std::min(head, HISTORY);
+        out.resize(n);
+        for (int i = 0; i < n; i++) {
+            out[i] = series.samples[(head - n + i) % HISTORY].load(
+                std::memory_order_relaxed);
+        }
+    }
+
+  protected:
+    struct Series {
+        std::atomic<float> samples[HISTORY] = {};
+        std::atomic<int> head = 0;
+    };
+
+    std::atomic<bool> enabled = false;
+    Series series[METRIC_COUNT];
+    std::atomic<int> counters[COUNTER_COUNT] = {};
+};
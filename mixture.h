@@ -5,6 +5,8 @@
 #include <string>
 #include <vector>
 
+#include "statehash.h"
+
 class Mixture {
   public:
     Mixture() {}
@@ -15,7 +17,9 @@ class Mixture {
     }
 
     bool isEmpty() const { return ingredients.size() == 0; }
-    const std::vector<std::string> &getIngredients() { return ingredients; }
+    const std::vector<std::string> &getIngredients() const {
+        return ingredients;
+    }
 
     void add(const std::string &ingredient) {
         auto it = std::lower_bound(ingredients.begin(), ingredients.end(),
@@ -32,10 +36,21 @@ class Mixture {
 
     std::string toString() const {
         std::string s;
+        appendTo(s);
+        return s;
+    }
+    void appendTo(std::string &out) const {
         for (auto &ingredient : ingredients) {
-            s += ingredient + " ";
+            out += ingredient;
+            out += ' ';
+        }
+    }
+
+    void hash(StateHasher &hasher) const {
+        hasher.add(int(ingredients.size()));
+        for (auto &ingredient : ingredients) {
+            hasher.add(ingredient);
         }
-        return s;
     }
 
     friend bool operator==(const Mixture &lhs, const Mixture &rhs) {
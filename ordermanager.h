@@ -4,17 +4,29 @@
 #include <random>
 #include <vector>
 
+#include "events.h"
 #include "mixture.h"
+#include "timerwheel.h"
 
 class Order {
   public:
-    Order(const Mixture &mixture, int price, int time)
-        : mixture(mixture), price(price), countdown(time), totalTime(time) {}
+    Order(const Mixture &mixture, int price, int time, int deadline, int id)
+        : mixture(mixture), price(price), totalTime(time), deadline(deadline),
+          id(id) {}
 
     Mixture mixture;
     int price;
-    int countdown;
     int totalTime;
+    // The frame in which the order expires.
+    int deadline;
+    int id;
+
+    uint64_t hash() const {
+        StateHasher hasher;
+        mixture.hash(hasher);
+        hasher.add(price).add(totalTime).add(deadline).add(id);
+        return componentHash(HashComponent::Order, id, hasher.get());
+    }
 };
 
 class OrderTemplate {
@@ -22,7 +34,9 @@ class OrderTemplate {
     OrderTemplate(const Mixture &mixture, int price, int time, int weight)
         : mixture(mixture), price(price), time(time), weight(weight) {}
 
-    Order generate() { return Order(mixture, price, time); }
+    Order generate(int now, int id) {
+        return Order(mixture, price, time, now + time, id);
+    }
 
     Mixture mixture;
     int price;
@@ -30,10 +44,13 @@ class OrderTemplate {
     int weight;
 };
 
-class OrderManager {
+class OrderManager : public ITimerListener {
   public:
     OrderManager() {}
 
+    void setTimers(TimerWheel *timers) { this->timers = timers; }
+    void setEvents(GameEventBus *events) { this->events = events; }
+
     int getFrame() { return time; }
     int getTimeCountdown() { return timeCountdown; }
     void setTimeCountdown(int time) { timeCountdown = time; }
@@ -46,28 +63,65 @@ class OrderManager {
     }
 
     const std::vector<Order> &getOrders() { return orders; }
+    // The XOR of the hashes of the orders, kept up to date as they come
+    // and go.
+    uint64_t getOrderHash() { return orderHash; }
+
+    void hash(StateHasher &hasher) {
+        hasher.add(time).add(timeCountdown).add(fund).add(tipFactor);
+        hasher.add(nextOrderId);
+    }
+    int getCountdown(const Order &order) { return order.deadline - time; }
 
     void setRandomizeSeed(int seed) { e.seed(seed); }
 
+    // Replace the current orders with ones generated from a new seed.
+    void restart(unsigned seed) {
+        e.seed(seed);
+        orders.clear();
+        orderHash = 0;
+        tipFactor = 0;
+        for (int i = 0; i < 4; i++) {
+            generateOrder();
+        }
+    }
+
+    // Expired orders are removed by their timers before this runs.
     void step() {
         time++;
         timeCountdown--;
-        for (auto &order : orders) {
-            order.countdown--;
-            if (order.countdown <= 0) {
-                tipFactor = 0;
-            }
-        }
-        orders.erase(std::remove_if(orders.begin(), orders.end(),
-                                    [](const Order &order) {
-                                        return order.countdown <= 0;
-                                    }),
-                     orders.end());
         for (auto i = orders.size(); i < 4; i++) {
             generateOrder();
         }
     }
 
+    void onTimer(int id) override {
+        auto it = std::find_if(orders.begin(), orders.end(),
+                               [id](const Order &order) {
+                                   return order.id == id;
+                               });
+        // The order may have been served already.
+        if (it != orders.end()) {
+            orderHash ^= it->hash();
+            orders.erase(it);
+            tipFactor = 0;
+            events->publish(OrderExpiredEvent{id});
+        }
+    }
+
+    // Register the deadlines of the orders again, after the timers were
+    // reset to load a saved state.
+    void scheduleOrders() {
+        for (auto &order : orders) {
+            timers->schedule(order.deadline, this, order.id);
+        }
+    }
+
+    void skipFrames(int frames) {
+        time += frames;
+        timeCountdown -= frames;
+    }
+
     int serveDish(const Mixture &mixture) {
         auto orderPos = orders.size();
         for (auto i = 0; i < orders.size(); i++) {
@@ -75,7 +129,7 @@ class OrderManager {
                 if (orderPos == orders.size()) {
                     orderPos = i;
                 } else {
-                    if (orders[i].countdown < orders[orderPos].countdown) {
+                    if (orders[i].deadline < orders[orderPos].deadline) {
                         orderPos = i;
                     }
                 }
@@ -87,10 +141,11 @@ class OrderManager {
         }
 
         auto order = &orders[orderPos];
+        int countdown = getCountdown(*order);
         int tip = 8;
-        if (order->countdown < order->totalTime / 3) {
+        if (countdown < order->totalTime / 3) {
             tip = 3;
-        } else if (order->countdown < order->totalTime * 2 / 3) {
+        } else if (countdown < order->totalTime * 2 / 3) {
             tip = 5;
         } else {
             tip = 8;
@@ -104,6 +159,7 @@ class OrderManager {
         } else {
             tipFactor = 0;
         }
+        orderHash ^= order->hash();
         orders.erase(orders.begin() + orderPos);
         return price;
     }
@@ -113,7 +169,10 @@ class OrderManager {
         int r = u(e);
         for (auto &orderTemplate : templates) {
             if (r < orderTemplate.weight) {
-                orders.push_back(orderTemplate.generate());
+                orders.push_back(orderTemplate.generate(time, nextOrderId));
+                orderHash ^= orders.back().hash();
+                timers->schedule(orders.back().deadline, this, nextOrderId);
+                nextOrderId++;
                 break;
             }
             r -= orderTemplate.weight;
@@ -127,8 +186,13 @@ class OrderManager {
     int tipFactor = 0;
 
     std::vector<Order> orders;
+    uint64_t orderHash = 0;
+    int nextOrderId = 0;
     std::vector<OrderTemplate> templates;
     int totalWeight = 0;
 
     std::default_random_engine e;
+
+    TimerWheel *timers = nullptr;
+    GameEventBus *events = nullptr;
 };
@@ -0,0 +1,210 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <box2d/box2d.h>
+
+#include "interfaces.h"
+
+class StaticGeometry;
+
+enum class PhysicsKind {
+    Box2D,
+    Grid,
+    // Box2D drives the game, the grid backend follows and is compared.
+    Validate,
+};
+
+inline PhysicsKind getPhysicsKind(const std::string &name) {
+    if (name == "box2d") {
+        return PhysicsKind::Box2D;
+    } else if (name == "grid") {
+        return PhysicsKind::Grid;
+    } else if (name == "validate") {
+        return PhysicsKind::Validate;
+    }
+    throw std::runtime_error("getPhysicsKind: Unknown physics " + name);
+}
+
+inline std::string getPhysicsName(PhysicsKind kind) {
+    switch (kind) {
+    case PhysicsKind::Box2D:
+        return "box2d";
+    case PhysicsKind::Grid:
+        return "grid";
+    case PhysicsKind::Validate:
+        return "validate";
+    }
+    throw std::runtime_error("getPhysicsName: Unknown physics kind");
+}
+
+// The physics of the players. Static geometry is fixed after init(), and
+// every player is a circle addressed by the index returned from addCircle().
+class PhysicsBackend {
+  public:
+    virtual ~PhysicsBackend() {}
+
+    virtual void init(StaticGeometry *geometry) = 0;
+    // Contacts are reported to owner, unless it is nullptr.
+    virtual int addCircle(b2Vec2 position, float radius, IBody *owner) = 0;
+
+    virtual b2Vec2 getPosition(int body) = 0;
+    virtual b2Vec2 getVelocity(int body) = 0;
+    virtual void setVelocity(int body, b2Vec2 velocity) = 0;
+    virtual void applyForce(int body, b2Vec2 force) = 0;
+    virtual void setTransform(int body, b2Vec2 position) = 0;
+    virtual bool isEnabled(int body) = 0;
+    virtual void setEnabled(int body, bool enabled) = 0;
+    virtual bool isAwake(int body) { return true; }
+    virtual void setAwake(int body, bool awake) {}
+    // The contacts remembered from the last step, which decide the contacts
+    // reported as new in the next one. A backend that can restore keeps all
+    // of its state in them and the bodies, so that a saved game goes on
+    // exactly as it would have.
+    virtual bool canRestore() { return false; }
+    virtual void saveContacts(std::vector<int> &contacts) {
+        contacts.clear();
+    }
+    virtual void loadContacts(const std::vector<int> &contacts) {}
+
+    virtual void step(float dt) = 0;
+
+    virtual void printReport(std::ostream &os) {}
+};
+
+// Forwards everything to both backends, reads from the reference and
+// records how far the candidate's trajectories drift away from it, and how
+// long each backend takes per step.
+class ValidatingPhysics : public PhysicsBackend {
+  public:
+    ValidatingPhysics(std::unique_ptr<PhysicsBackend> reference,
+                      std::unique_ptr<PhysicsBackend> candidate)
+        : reference(std::move(reference)), candidate(std::move(candidate)) {}
+
+    void init(StaticGeometry *geometry) override {
+        reference->init(geometry);
+        candidate->init(geometry);
+    }
+    int addCircle(b2Vec2 position, float radius, IBody *owner) override {
+        candidate->addCircle(position, radius, nullptr);
+        bodyCount++;
+        return reference->addCircle(position, radius, owner);
+    }
+
+    b2Vec2 getPosition(int body) override {
+        return reference->getPosition(body);
+    }
+    b2Vec2 getVelocity(int body) override {
+        return reference->getVelocity(body);
+    }
+    void setVelocity(int body, b2Vec2 velocity) override {
+        reference->setVelocity(body, velocity);
+        candidate->setVelocity(body, velocity);
+    }
+    void applyForce(int body, b2Vec2 force) override {
+        reference->applyForce(body, force);
+        candidate->applyForce(body, force);
+    }
+    void setTransform(int body, b2Vec2 position) override {
+        reference->setTransform(body, position);
+        candidate->setTransform(body, position);
+    }
+    bool isEnabled(int body) override { return reference->isEnabled(body); }
+    void setEnabled(int body, bool enabled) override {
+        reference->setEnabled(body, enabled);
+        candidate->setEnabled(body, enabled);
+    }
+    bool isAwake(int body) override { return reference->isAwake(body); }
+    void setAwake(int body, bool awake) override {
+        reference->setAwake(body, awake);
+        candidate->setAwake(body, awake);
+    }
+    bool canRestore() override {
+        return reference->canRestore() && candidate->canRestore();
+    }
+    // The size of the reference's contacts, its contacts, then those of the
+    // candidate.
+    void saveContacts(std::vector<int> &contacts) override {
+        reference->saveContacts(referenceContacts);
+        candidate->saveContacts(candidateContacts);
+        contacts.assign(1, referenceContacts.size());
+        contacts.insert(contacts.end(), referenceContacts.begin(),
+                        referenceContacts.end());
+        contacts.insert(contacts.end(), candidateContacts.begin(),
+                        candidateContacts.end());
+    }
+    void loadContacts(const std::vector<int> &contacts) override {
+        auto split = contacts.begin() + 1 + contacts[0];
+        referenceContacts.assign(contacts.begin() + 1, split);
+        candidateContacts.assign(split, contacts.end());
+        reference->loadContacts(referenceContacts);
+        candidate->loadContacts(candidateContacts);
+    }
+
+    void step(float dt) override {
+        auto start = Clock::now();
+        reference->step(dt);
+        auto middle = Clock::now();
+        candidate->step(dt);
+        referenceTime += middle - start;
+        candidateTime += Clock::now() - middle;
+        frame++;
+        for (int i = 0; i < bodyCount; i++) {
+            if (!reference->isEnabled(i)) {
+                continue;
+            }
+            float error =
+                (reference->getPosition(i) - candidate->getPosition(i))
+                    .Length();
+            totalError += error;
+            samples++;
+            if (error > maxError) {
+                maxError = error;
+                maxErrorFrame = frame;
+            }
+            if (error > DIVERGENCE_THRESHOLD && firstDivergence < 0) {
+                firstDivergence = frame;
+            }
+        }
+    }
+
+    void printReport(std::ostream &os) override {
+        os << "Physics divergence: mean " << totalError / std::max(samples, 1)
+           << ", max " << maxError << " at frame " << maxErrorFrame
+           << ", first above " << DIVERGENCE_THRESHOLD << " at frame "
+           << firstDivergence << "\n";
+        double reference = referenceTime.count() / std::max(frame, 1);
+        double candidate = candidateTime.count() / std::max(frame, 1);
+        os << "Physics step time: reference " << reference
+           << " us, candidate " << candidate << " us, "
+           << reference / std::max(candidate, 1e-9) << "x\n";
+    }
+
+  protected:
+    // In tiles.
+    static constexpr float DIVERGENCE_THRESHOLD = 0.1f;
+
+    std::unique_ptr<PhysicsBackend> reference;
+    std::unique_ptr<PhysicsBackend> candidate;
+
+    int frame = 0;
+    double totalError = 0;
+    int samples = 0;
+    float maxError = 0;
+    int maxErrorFrame = -1;
+    int firstDivergence = -1;
+
+    using Clock = std::chrono::steady_clock;
+    std::chrono::duration<double, std::micro> referenceTime{0};
+    std::chrono::duration<double, std::micro> candidateTime{0};
+
+    int bodyCount = 0;
+    std::vector<int> referenceContacts;
+    std::vector<int> candidateContacts;
+};
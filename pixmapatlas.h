@@ -0,0 +1,144 @@
+#pragma once
+
+#include <QPainter>
+#include <QPixmap>
+#include <QRect>
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include "enums.h"
+
+enum class Sprite {
+    None = -1,
+    Plate,
+    Pan,
+    Pot,
+    Fish,
+    Kelp,
+    Rice,
+    ChoppingStation,
+    Stove,
+    Trashbin,
+    PlateReturn,
+    Sink,
+    PlateRack,
+};
+constexpr int SPRITE_COUNT = int(Sprite::PlateRack) + 1;
+
+inline Sprite getTileSprite(TileKind kind) {
+    switch (kind) {
+    case TileKind::ChoppingStation:
+        return Sprite::ChoppingStation;
+    case TileKind::Stove:
+        return Sprite::Stove;
+    case TileKind::Trashbin:
+        return Sprite::Trashbin;
+    case TileKind::PlateReturn:
+        return Sprite::PlateReturn;
+    case TileKind::Sink:
+        return Sprite::Sink;
+    case TileKind::PlateRack:
+        return Sprite::PlateRack;
+    default:
+        return Sprite::None;
+    }
+}
+
+inline Sprite getIngredientSprite(const std::string &ingredient) {
+    if (ingredient == "fish") {
+        return Sprite::Fish;
+    } else if (ingredient == "kelp") {
+        return Sprite::Kelp;
+    } else if (ingredient == "rice") {
+        return Sprite::Rice;
+    }
+    throw std::runtime_error("No sprite for ingredient " + ingredient);
+}
+
+inline Sprite getContainerSprite(ContainerKind kind) {
+    switch (kind) {
+    case ContainerKind::Plate:
+        return Sprite::Plate;
+    case ContainerKind::Pan:
+        return Sprite::Pan;
+    case ContainerKind::Pot:
+        return Sprite::Pot;
+    default:
+        return Sprite::None;
+    }
+}
+
+// Every image of the GUI, decoded and scaled once and packed side by side
+// into one pixmap. Static layers blit from the sheet, items that need a
+// QPixmap of their own get a shared copy of the sprite, which is free.
+// Each thread that draws gets atlases of its own.
+class PixmapAtlas {
+  public:
+    PixmapAtlas(const PixmapAtlas &) = delete;
+    PixmapAtlas &operator=(const PixmapAtlas &) = delete;
+
+    // The atlas of the given number of pixels per tile, built on first use.
+    static PixmapAtlas &get(float scale) {
+        static thread_local std::map<float, std::unique_ptr<PixmapAtlas>>
+            atlases;
+        auto &atlas = atlases[scale];
+        if (atlas == nullptr) {
+            atlas.reset(new PixmapAtlas(scale));
+        }
+        return *atlas;
+    }
+
+    const QPixmap &getSheet() { return sheet; }
+    QRect getRect(Sprite sprite) { return rects[int(sprite)]; }
+    const QPixmap &getPixmap(Sprite sprite) { return pixmaps[int(sprite)]; }
+
+    void draw(QPainter *painter, Sprite sprite, QPointF pos) {
+        auto rect = getRect(sprite);
+        painter->drawPixmap(pos, sheet, rect);
+    }
+
+  protected:
+    QPixmap sheet;
+    QRect rects[SPRITE_COUNT];
+    QPixmap pixmaps[SPRITE_COUNT];
+
+    explicit PixmapAtlas(float scale) {
+        struct Source {
+            const char *path;
+            float size;
+        };
+        // In the order of Sprite, sizes in tiles.
+        const Source sources[SPRITE_COUNT] = {
+            {":/img/images/Plate.png", 1},
+            {":/img/images/Pan.PNG", 1.5},
+            {":/img/images/Pot.PNG", 2},
+            {":/img/images/fish.png", 1},
+            {":/img/images/kelp.png", 1},
+            {":/img/images/rice.png", 1},
+            {":/img/images/ChoppingStation.png", 1},
+            {":/img/images/Stove.png", 1},
+            {":/img/images/Trashbin.png", 1},
+            {":/img/images/PlateReturn.png", 1},
+            {":/img/images/Sink.png", 1},
+            {":/img/images/PlateRack.png", 1},
+        };
+
+        int width = 0, height = 0;
+        for (int i = 0; i < SPRITE_COUNT; i++) {
+            int size = sources[i].size * scale;
+            pixmaps[i] = QPixmap(sources[i].path).scaled(size, size);
+            rects[i] = QRect(width, 0, size, size);
+            width += size;
+            height = std::max(height, size);
+        }
+        sheet = QPixmap(width, height);
+        sheet.fill(Qt::transparent);
+        QPainter painter(&sheet);
+        for (int i = 0; i < SPRITE_COUNT; i++) {
+            painter.drawPixmap(rects[i].topLeft(), pixmaps[i]);
+        }
+    }
+};
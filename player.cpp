@@ -7,21 +7,21 @@ void Player::lateUpdate() {
     if (respawnCountdown > 0) {
         respawnCountdown--;
         if (respawnCountdown == 0) {
-            body->SetEnabled(true);
+            physics->setEnabled(bodyId, true);
         }
         return;
     }
 
-    int tileX = body->GetPosition().x;
-    int tileY = body->GetPosition().y;
-    auto tile = gameManager->getTile(tileX, tileY);
-    if (tile->getTileKind() == TileKind::Void) {
-        body->SetTransform(spawnPoint, 0);
-        body->SetLinearVelocity(b2Vec2(0, 0));
-        body->SetEnabled(false);
+    int tileX = getPosition().x;
+    int tileY = getPosition().y;
+    if (gameManager->getTileKindAt(tileX, tileY) == TileKind::Void) {
+        physics->setTransform(bodyId, spawnPoint);
+        physics->setVelocity(bodyId, b2Vec2(0, 0));
+        physics->setEnabled(bodyId, false);
         if (!onHand.isNull()) {
             onHand.setMixture(Mixture());
         }
+        gameManager->events.publish(PlayerFellEvent{id, !onHand.isNull()});
         if (!onHand.isNull()) {
             auto container = std::move(onHand);
             gameManager->entityManager.scheduleRespawn(std::move(container),
@@ -32,10 +32,7 @@ void Player::lateUpdate() {
     }
 
     if (tileInteracting != nullptr) {
-        auto distance = (body->GetPosition() - tileInteracting->getPos() -
-                         b2Vec2(0.5f, 0.5f))
-                            .Length();
-        if (distance > PLAYER_INTERACT_DISTANCE) {
+        if (!isNear(tileInteracting, PLAYER_INTERACT_DISTANCE)) {
             tileInteracting = nullptr;
         }
     }
@@ -45,3 +42,15 @@ void Player::lateUpdate() {
         }
     }
 }
+
+void Player::collision(IBody *entity) {
+    if (!onHand.isEmpty()) {
+        onHand.setCollided();
+    }
+    if (gameManager->events.hasListeners<CollisionEvent>()) {
+        int other = entity->getBodyKind() == BodyKind::Player
+                        ? static_cast<Player *>(entity)->getId()
+                        : -1;
+        gameManager->events.publish(CollisionEvent{id, other});
+    }
+}
@@ -1,14 +1,30 @@
 #ifndef PLAYER_H_
 #define PLAYER_H_
 
+#include <cmath>
+
 #include <box2d/box2d.h>
 
 #include "config.h"
+#include "fixed.h"
+#include "gamestate.h"
 #include "interfaces.h"
+#include "physics.h"
 #include "tile.h"
 
 class GameManager;
 
+// The movement constants for the fixed-point mode.
+constexpr Fixed FIXED_PLAYER_ACCELERATION =
+    Fixed::fromFloat(PLAYER_ACCELERATION);
+constexpr Fixed FIXED_PLAYER_DECELERATION =
+    Fixed::fromFloat(PLAYER_DECELERATION);
+constexpr Fixed FIXED_PLAYER_FRICTION = Fixed::fromFloat(PLAYER_FRICTION);
+constexpr Fixed FIXED_PLAYER_MAX_SPEED = Fixed::fromFloat(PLAYER_MAX_SPEED);
+constexpr Fixed FIXED_PLAYER_EPISILON_SPEED =
+    Fixed::fromFloat(PLAYER_EPISILON_SPEED);
+constexpr Fixed FIXED_MOVE_THRESHOLD = Fixed::fromFloat(0.1f);
+
 class Player : public IUpdatable, public IBody {
   public:
     Player() { bodyKind = BodyKind::Player; }
@@ -16,24 +32,20 @@ class Player : public IUpdatable, public IBody {
     void setLevelManager(GameManager *gameManager) {
         this->gameManager = gameManager;
     }
+    void setId(int id) { this->id = id; }
+    int getId() { return id; }
     void setSpawnPoint(b2Vec2 point) { spawnPoint = point; }
+    // Use integer arithmetic for the movement and the distance checks.
+    void setFixedPoint(bool fixedPoint) { this->fixedPoint = fixedPoint; }
 
-    void initB2(b2World *world) {
-        b2BodyDef bodyDef;
-        bodyDef.type = b2_dynamicBody;
-        bodyDef.position.Set(spawnPoint.x, spawnPoint.y);
-        bodyDef.fixedRotation = true;
-        body = world->CreateBody(&bodyDef);
-        b2CircleShape shape;
-        shape.m_radius = PLAYER_RADIUS;
-        b2FixtureDef fixtureDef;
-        fixtureDef.shape = &shape;
-        fixtureDef.density = 1.0f;
-        body->CreateFixture(&fixtureDef);
-
-        setUserData(BodyKind::Player);
+    void initPhysics(PhysicsBackend *physics) {
+        this->physics = physics;
+        bodyId = physics->addCircle(spawnPoint, PLAYER_RADIUS, this);
     }
 
+    b2Vec2 getPosition() { return physics->getPosition(bodyId); }
+    b2Vec2 getVelocity() { return physics->getVelocity(bodyId); }
+
     void move(b2Vec2 direction) {
         if (respawnCountdown > 0) {
             return;
@@ -43,7 +55,12 @@ class Player : public IUpdatable, public IBody {
     }
 
     void updateMove(b2Vec2 direction) {
-        b2Vec2 velocity = body->GetLinearVelocity();
+        if (fixedPoint) {
+            updateMoveFixed(FixedVec2(direction));
+            return;
+        }
+
+        b2Vec2 velocity = getVelocity();
         b2Vec2 velocityDirection = velocity;
         velocityDirection.Normalize();
         float friction = PLAYER_FRICTION;
@@ -51,7 +68,7 @@ class Player : public IUpdatable, public IBody {
         if (direction.Length() > 0.1f) {
             direction.Normalize();
             direction *= PLAYER_ACCELERATION;
-            body->ApplyForceToCenter(direction, true);
+            physics->applyForce(bodyId, direction);
         } else {
             friction += PLAYER_DECELERATION;
         }
@@ -59,27 +76,63 @@ class Player : public IUpdatable, public IBody {
         if (velocity.Length() > PLAYER_EPISILON_SPEED || direction.Length() > 0.1f) {
             auto force = velocityDirection;
             force *= -friction;
-            body->ApplyForceToCenter(force, true);
+            physics->applyForce(bodyId, force);
         } else {
-            body->SetLinearVelocity(b2Vec2(0, 0));
+            physics->setVelocity(bodyId, b2Vec2(0, 0));
         }
 
         if (velocity.Length() > PLAYER_MAX_SPEED) {
             auto speed = velocityDirection;
             speed *= PLAYER_MAX_SPEED;
-            body->SetLinearVelocity(speed);
+            physics->setVelocity(bodyId, speed);
+        }
+    }
+
+    void updateMoveFixed(FixedVec2 direction) {
+        FixedVec2 velocity(getVelocity());
+        FixedVec2 velocityDirection = velocity.normalized();
+        Fixed friction = FIXED_PLAYER_FRICTION;
+
+        bool moving = direction.isLongerThan(FIXED_MOVE_THRESHOLD);
+        if (moving) {
+            auto force =
+                direction.normalized() * FIXED_PLAYER_ACCELERATION;
+            physics->applyForce(bodyId, force.toB2());
+        } else {
+            friction += FIXED_PLAYER_DECELERATION;
+        }
+
+        if (velocity.isLongerThan(FIXED_PLAYER_EPISILON_SPEED) || moving) {
+            auto force = velocityDirection * -friction;
+            physics->applyForce(bodyId, force.toB2());
+        } else {
+            physics->setVelocity(bodyId, b2Vec2(0, 0));
+        }
+
+        if (velocity.isLongerThan(FIXED_PLAYER_MAX_SPEED)) {
+            auto speed = velocityDirection * FIXED_PLAYER_MAX_SPEED;
+            physics->setVelocity(bodyId, speed.toB2());
         }
     }
 
+    // Whether the center of the tile is within distance of the player.
+    bool isNear(Tile *tile, float distance) {
+        if (fixedPoint) {
+            auto offset = FixedVec2(getPosition()) - FixedVec2(tile->getPos()) -
+                          FixedVec2(Fixed::fromRaw(Fixed::ONE / 2),
+                                    Fixed::fromRaw(Fixed::ONE / 2));
+            return !offset.isLongerThan(Fixed::fromFloat(distance));
+        }
+        auto offset = getPosition() - tile->getPos() - b2Vec2(0.5f, 0.5f);
+        return offset.Length() <= distance;
+    }
+
     void putOrPick(Tile *tile) {
         if (respawnCountdown > 0) {
             return;
         }
 
-        auto distance =
-            (body->GetPosition() - tile->getPos() - b2Vec2(0.5f, 0.5f))
-                .Length();
-        if (distance > PLAYER_PUTORPICK_DISTANCE) {
+        if (!isNear(tile, PLAYER_PUTORPICK_DISTANCE)) {
             return;
         }
 
@@ -103,30 +156,102 @@ class Player : public IUpdatable, public IBody {
     }
 
     void update() override {
+        lastPosition = getPosition();
         updateMove(moveDirection);
         moveDirection.SetZero();
     }
 
     void lateUpdate() override;
 
-    void collision(IBody *entity) {
-        if (!onHand.isEmpty()) {
-            onHand.setCollided();
+    int getIdleFrames() override {
+        if (respawnCountdown > 0) {
+            return respawnCountdown - 1;
         }
+        // At rest only if the last step did not move the player either, so
+        // that the physics has nothing left to resolve.
+        bool atRest = tileInteracting == nullptr &&
+                      moveDirection.LengthSquared() == 0 &&
+                      getVelocity().LengthSquared() == 0 &&
+                      getPosition() == lastPosition;
+        return atRest ? std::numeric_limits<int>::max() : 0;
+    }
+    void skipFrames(int frames) override {
+        if (respawnCountdown > 0) {
+            respawnCountdown -= frames;
+        }
+    }
+
+    bool canSleep() override {
+        return respawnCountdown == 0 &&
+               getIdleFrames() == std::numeric_limits<int>::max();
+    }
+    // Whether the physics moved the player, for example another player
+    // pushing it, since it went to sleep.
+    bool isDisturbed() {
+        return getVelocity().LengthSquared() != 0 ||
+               getPosition() != lastPosition;
     }
 
+    void collision(IBody *entity) override;
+
     int getRespawnCountdown() { return respawnCountdown; }
 
+    // Covers what a GameState keeps, except for the sleep state of the
+    // physics body, which does not change the outcome.
+    uint64_t hash() {
+        StateHasher hasher;
+        hasher.add(getPosition()).add(getVelocity());
+        hasher.add(physics->isEnabled(bodyId)).add(respawnCountdown);
+        hasher.add(onHand.hash());
+        hasher.add(tileInteracting != nullptr ? tileInteracting->getPos()
+                                              : b2Vec2(-1, -1));
+        hasher.add(moveDirection);
+        return componentHash(HashComponent::Player, id, hasher.get());
+    }
+
+    void saveState(PlayerState &state) {
+        state.position = getPosition();
+        state.velocity = getVelocity();
+        state.enabled = physics->isEnabled(bodyId);
+        state.awake = physics->isAwake(bodyId);
+        state.respawnCountdown = respawnCountdown;
+        state.onHand.copyFrom(onHand);
+        state.tileInteracting = tileInteracting;
+        state.moveDirection = moveDirection;
+    }
+
+    void loadState(PlayerState &state) {
+        // A body that has not moved is left alone, so that a reset game makes
+        // the same calls to the physics as a newly loaded one.
+        if (getPosition() != state.position) {
+            physics->setTransform(bodyId, state.position);
+        }
+        physics->setEnabled(bodyId, state.enabled);
+        physics->setAwake(bodyId, state.awake);
+        physics->setVelocity(bodyId, state.velocity);
+        respawnCountdown = state.respawnCountdown;
+        onHand.copyFrom(state.onHand);
+        tileInteracting = state.tileInteracting;
+        moveDirection = state.moveDirection;
+        lastPosition.Set(NAN, NAN);
+    }
+
     ContainerHolder *getOnHand() { return &onHand; }
 
   protected:
     GameManager *gameManager;
+    int id = 0;
+    PhysicsBackend *physics = nullptr;
+    int bodyId = -1;
+    bool fixedPoint = false;
     b2Vec2 spawnPoint;
     int respawnCountdown = 0;
 
     ContainerHolder onHand;
     Tile *tileInteracting = nullptr;
     b2Vec2 moveDirection{0, 0};
+    // Where the player was before the last step, NaN before the first one.
+    b2Vec2 lastPosition{NAN, NAN};
 };
 
 #endif
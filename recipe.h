@@ -15,6 +15,12 @@ class Recipe {
         : ingredients(ingredients), result(result),
           containerKind(containerKind), tileKind(tileKind), time(time) {}
 
+    void hash(StateHasher &hasher) const {
+        ingredients.hash(hasher);
+        result.hash(hasher);
+        hasher.add(int(containerKind)).add(int(tileKind)).add(time);
+    }
+
     Mixture ingredients;
     Mixture result;
     ContainerKind containerKind;
@@ -0,0 +1,239 @@
+#include <QApplication>
+#include <QDir>
+#include <QFile>
+#include <QImage>
+#include <QPainter>
+#include <QThread>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "gamemanager.h"
+#include "guimanager.h"
+#include "inputs.h"
+#include "mygetopt.h"
+#include "rendersnapshot.h"
+#include "replay.h"
+#include "replayplayer.h"
+
+// Renders frames of a replay without a display, with the drawing code of
+// the GUI. Frame f is the state after f frames of inputs.
+//
+// The frames are split into chunks that the threads take in order. Each
+// thread plays the replay on a game of its own and seeks ahead to its next
+// chunk, which only costs simulation. PNG files are written as soon as
+// they are drawn; raw frames wait until the chunks before them are out.
+
+// Enough to keep the threads busy without holding many raw frames.
+constexpr int CHUNK_FRAMES = FPS / 2;
+
+struct RenderJob {
+    const char *data;
+    size_t size;
+    PhysicsKind physicsKind = PhysicsKind::Box2D;
+    bool fixedPoint = false;
+    int begin = 0, end = 0;
+    QRect frameRect;
+    // The directory of the PNG sequence, or empty for raw RGB on stdout.
+    QString outputDir;
+
+    std::atomic<int> nextChunk = 0;
+    std::mutex mutex;
+    std::condition_variable written;
+    int writtenChunks = 0;
+    std::string error;
+};
+
+void writeRaw(const QImage &image) {
+    int lineSize = image.width() * 3;
+    for (int y = 0; y < image.height(); y++) {
+        fwrite(image.constScanLine(y), 1, lineSize, stdout);
+    }
+}
+
+void renderChunks(RenderJob &job) {
+    ReplayIndex index(job.data, job.size);
+    GameManager gameManager;
+    gameManager.setPhysicsKind(job.physicsKind);
+    gameManager.setFixedPoint(job.fixedPoint);
+    gameManager.loadLevel(index.getLevel());
+    GuiManager scene(&gameManager);
+    scene.init();
+    ReplayPlayer player(&gameManager, &index,
+                        [&](const std::vector<std::string> &inputs) {
+                            applyInputs(&gameManager, inputs);
+                            gameManager.step();
+                        });
+    RenderSnapshot snapshot;
+    std::vector<QImage> images;
+
+    while (true) {
+        int chunk = job.nextChunk++;
+        int first = job.begin + chunk * CHUNK_FRAMES;
+        if (first >= job.end) {
+            break;
+        }
+        int last = std::min(first + CHUNK_FRAMES, job.end);
+        images.clear();
+        for (int frame = first; frame < last; frame++) {
+            player.seek(frame);
+            snapshot.capture(&gameManager);
+            scene.updateItem(snapshot);
+            QImage image(job.frameRect.size(), QImage::Format_RGB888);
+            image.fill(Qt::white);
+            QPainter painter(&image);
+            painter.setRenderHint(QPainter::Antialiasing);
+            scene.render(&painter, QRectF(image.rect()), job.frameRect);
+            painter.end();
+            // The scene posts its change notifications to this thread.
+            QCoreApplication::processEvents();
+
+            if (!job.outputDir.isEmpty()) {
+                auto name =
+                    QString("frame_%1.png").arg(frame, 6, 10, QChar('0'));
+                if (!image.save(QDir(job.outputDir).filePath(name))) {
+                    throw std::runtime_error("Cannot write " +
+                                             name.toStdString());
+                }
+            } else {
+                images.push_back(std::move(image));
+            }
+        }
+
+        if (job.outputDir.isEmpty()) {
+            std::unique_lock<std::mutex> lk(job.mutex);
+            job.written.wait(lk, [&]() {
+                return job.writtenChunks == chunk || !job.error.empty();
+            });
+            if (!job.error.empty()) {
+                return;
+            }
+            for (auto &image : images) {
+                writeRaw(image);
+            }
+            job.writtenChunks++;
+            job.written.notify_all();
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    // No display server needed.
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+    QApplication app(argc, argv);
+
+    const char *replayFile = nullptr;
+    const char *outputDir = nullptr;
+    int threads = QThread::idealThreadCount();
+    int begin = 0, end = -1;
+    PhysicsKind physicsKind = PhysicsKind::Box2D;
+    bool fixedPoint = false;
+    bool physicsGiven = false;
+    bool fixedPointGiven = false;
+    int o;
+    while ((o = getopt(argc, argv, "R:o:j:b:e:P:x")) != -1) {
+        switch (o) {
+        case 'R':
+            replayFile = optarg;
+            break;
+        case 'o':
+            outputDir = optarg;
+            break;
+        case 'j':
+            threads = std::max(atoi(optarg), 1);
+            break;
+        case 'b':
+            begin = atoi(optarg);
+            break;
+        case 'e':
+            end = atoi(optarg);
+            break;
+        case 'P':
+            physicsKind = getPhysicsKind(optarg);
+            physicsGiven = true;
+            break;
+        case 'x':
+            fixedPoint = true;
+            fixedPointGiven = true;
+            break;
+        default:
+            fprintf(stderr, "Unknown commandline argument %c\n", o);
+            break;
+        }
+    }
+    if (replayFile == nullptr) {
+        fprintf(stderr, "Usage: render -R <replay> [-o <directory>] [-j "
+                        "<threads>] [-b <first frame>] [-e <end frame>]\n"
+                        "Without -o, raw RGB frames go to stdout.\n");
+        return 1;
+    }
+
+    QFile file(replayFile);
+    if (!file.open(QIODevice::ReadOnly)) {
+        throw std::runtime_error(std::string("Cannot open replay ") +
+                                 replayFile);
+    }
+    auto data = reinterpret_cast<const char *>(file.map(0, file.size()));
+    if (data == nullptr) {
+        throw std::runtime_error(std::string("Cannot map replay ") +
+                                 replayFile);
+    }
+
+    RenderJob job;
+    job.data = data;
+    job.size = file.size();
+    if (outputDir != nullptr) {
+        job.outputDir = outputDir;
+        QDir().mkpath(job.outputDir);
+    }
+
+    {
+        ReplayIndex index(data, file.size());
+        useReplayPhysics(index, physicsKind, physicsGiven, fixedPoint,
+                         fixedPointGiven);
+        job.physicsKind = physicsKind;
+        job.fixedPoint = fixedPoint;
+        int frameCount = index.getFrameCount();
+        job.begin = std::clamp(begin, 0, frameCount);
+        job.end = std::clamp(end < 0 ? frameCount + 1 : end, job.begin,
+                             frameCount + 1);
+        GameManager gameManager;
+        gameManager.setPhysicsKind(physicsKind);
+        gameManager.setFixedPoint(fixedPoint);
+        gameManager.loadLevel(index.getLevel());
+        GuiManager scene(&gameManager);
+        scene.init();
+        job.frameRect = scene.getFrameRect();
+    }
+    fprintf(stderr, "Rendering frames %d to %d at %dx%d on %d threads\n",
+            job.begin, job.end - 1, job.frameRect.width(),
+            job.frameRect.height(), threads);
+
+    std::vector<QThread *> workers;
+    for (int i = 0; i < threads; i++) {
+        workers.push_back(QThread::create([&job]() {
+            try {
+                renderChunks(job);
+            } catch (std::exception &e) {
+                std::lock_guard<std::mutex> lk(job.mutex);
+                job.error = e.what();
+                job.written.notify_all();
+            }
+        }));
+        workers.back()->start();
+    }
+    for (auto worker : workers) {
+        worker->wait();
+        delete worker;
+    }
+    fflush(stdout);
+    if (!job.error.empty()) {
+        fprintf(stderr, "%s\n", job.error.c_str());
+        return 1;
+    }
+    return 0;
+}
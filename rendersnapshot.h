@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <box2d/box2d.h>
+
+#include "enums.h"
+#include "foodcontainer.h"
+#include "gamemanager.h"
+
+// What the GUI draws of a container.
+struct ContainerSnapshot {
+    // ContainerHolder::getVersion() at the time of the capture.
+    uint32_t version = 0;
+    ContainerKind kind = ContainerKind::None;
+    std::string text;
+    bool working = false;
+    float progress = 0;
+    float overcookProgress = 0;
+
+    // Each snapshot always captures the same container, so only changed
+    // containers are copied again.
+    void capture(ContainerHolder *container) {
+        if (version == container->getVersion()) {
+            return;
+        }
+        version = container->getVersion();
+        kind = container->getContainerKind();
+        text.clear();
+        container->appendTo(text);
+        working = container->isWorking();
+        progress = working ? container->getProgress() : 0;
+        overcookProgress = working ? container->getOvercookProgress() : 0;
+    }
+
+    bool operator==(const ContainerSnapshot &other) const = default;
+};
+
+struct PlayerSnapshot {
+    b2Vec2 position;
+    bool visible = true;
+    ContainerSnapshot onHand;
+};
+
+struct OrderSnapshot {
+    int countdown;
+    int price;
+    std::string mixture;
+};
+
+// A copy of everything the GUI draws of one frame, so that drawing does
+// not touch the game while the simulation thread runs it. The buffers are
+// reused, capturing into the same snapshot again rarely allocates.
+struct RenderSnapshot {
+    int frame = 0;
+    int totalFrames = 0;
+    int fund = 0;
+    std::vector<PlayerSnapshot> players;
+    // Indexed like GameManager::getContainerTiles().
+    std::vector<ContainerSnapshot> tileContainers;
+    std::vector<OrderSnapshot> orders;
+
+    void capture(GameManager *gameManager) {
+        auto orderManager = &gameManager->orderManager;
+        frame = orderManager->getFrame();
+        totalFrames = frame + orderManager->getTimeCountdown();
+        fund = orderManager->getFund();
+
+        auto &gamePlayers = gameManager->getPlayers();
+        players.resize(gamePlayers.size());
+        for (int i = 0; i < int(gamePlayers.size()); i++) {
+            players[i].position = gamePlayers[i]->getPosition();
+            players[i].visible = gamePlayers[i]->getRespawnCountdown() == 0;
+            players[i].onHand.capture(gamePlayers[i]->getOnHand());
+        }
+
+        auto &tiles = gameManager->getContainerTiles();
+        tileContainers.resize(tiles.size());
+        for (int i = 0; i < int(tiles.size()); i++) {
+            tileContainers[i].capture(tiles[i]->getContainer());
+        }
+
+        auto &gameOrders = orderManager->getOrders();
+        orders.resize(gameOrders.size());
+        for (int i = 0; i < int(gameOrders.size()); i++) {
+            orders[i].countdown = orderManager->getCountdown(gameOrders[i]);
+            orders[i].price = gameOrders[i].price;
+            orders[i].mixture.clear();
+            gameOrders[i].mixture.appendTo(orders[i].mixture);
+        }
+    }
+};
@@ -0,0 +1,345 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "physics.h"
+
+// The inputs of every frame of a game. Runs of frames with the same inputs
+// are stored once, so idle stretches are cheap to store and easy to spot.
+//
+// The file is plain text:
+//   Replay <level file>
+//   Physics <physics name> <1 with fixed-point movement, else 0>
+//   <player count>
+//   <frame count> followed by one line of input per player, repeated.
+// If the replay was recorded with state hashes, each frame count is
+// followed by the hash of the state after the last frame of the segment.
+//
+// Saved replays end with an index of the segments, which older readers
+// stop at:
+//   Index <segment count> <frame count>
+//   <first frame> <byte offset of the segment>, one per segment.
+//   <byte offset of the Index line>
+// The numbers of the last two parts are zero-padded to a fixed width, so
+// the index can be searched in place. See ReplayIndex. Replays saved before
+// the Physics line was added are still read, without the physics.
+class Replay {
+  public:
+    struct Segment {
+        int frames;
+        std::vector<std::string> inputs;
+        uint64_t hash = 0;
+    };
+
+    Replay() {}
+    Replay(const std::string &level, PhysicsKind physicsKind, bool fixedPoint)
+        : level(level), physicsKind(physicsKind), fixedPoint(fixedPoint) {}
+
+    const std::string &getLevel() { return level; }
+    // Empty if the replay does not say.
+    std::optional<PhysicsKind> getPhysicsKind() { return physicsKind; }
+    bool isFixedPoint() { return fixedPoint; }
+    const std::vector<Segment> &getSegments() { return segments; }
+    bool hasHashes() { return hashed; }
+    int getFrameCount() {
+        int frames = 0;
+        for (auto &segment : segments) {
+            frames += segment.frames;
+        }
+        return frames;
+    }
+
+    void add(const std::vector<std::string> &inputs) {
+        if (!segments.empty() && segments.back().inputs == inputs) {
+            segments.back().frames++;
+        } else {
+            segments.push_back(Segment{1, inputs});
+        }
+    }
+    // Add a frame along with the hash of the state after it.
+    void add(const std::vector<std::string> &inputs, uint64_t hash) {
+        add(inputs);
+        segments.back().hash = hash;
+        hashed = true;
+    }
+
+    void save(const std::string &path) {
+        std::ofstream out(path);
+        if (!out.good()) {
+            throw std::runtime_error("Cannot write replay " + path);
+        }
+        int playerCount =
+            segments.empty() ? 0 : segments.front().inputs.size();
+        out << "Replay " << level << "\n";
+        if (physicsKind.has_value()) {
+            out << "Physics " << getPhysicsName(*physicsKind) << " "
+                << fixedPoint << "\n";
+        }
+        out << playerCount << "\n";
+        std::vector<long long> offsets;
+        for (auto &segment : segments) {
+            offsets.push_back(out.tellp());
+            out << segment.frames;
+            if (hashed) {
+                char hash[17];
+                snprintf(hash, sizeof(hash), "%016llx",
+                         (unsigned long long)segment.hash);
+                out << " " << hash;
+            }
+            out << "\n";
+            for (auto &input : segment.inputs) {
+                out << input << "\n";
+            }
+        }
+
+        long long indexOffset = out.tellp();
+        out << "Index " << segments.size() << " " << getFrameCount() << "\n";
+        int frame = 0;
+        char entry[INDEX_ENTRY_SIZE + 1];
+        for (int i = 0; i < int(segments.size()); i++) {
+            snprintf(entry, sizeof(entry), "%010d %020lld\n", frame,
+                     offsets[i]);
+            out << entry;
+            frame += segments[i].frames;
+        }
+        snprintf(entry, sizeof(entry), "%020lld\n", indexOffset);
+        out << entry;
+    }
+
+    // One line of the index: "<first frame> <offset>\n".
+    static constexpr int INDEX_ENTRY_SIZE = 32;
+    // The last line: "<offset of the Index line>\n".
+    static constexpr int INDEX_FOOTER_SIZE = 21;
+
+    static Replay load(const std::string &path) {
+        std::ifstream in(path);
+        std::string magic;
+        in >> magic;
+        if (!in.good() || magic != "Replay") {
+            throw std::runtime_error("Invalid replay file " + path);
+        }
+        Replay replay;
+        std::getline(in >> std::ws, replay.level);
+        if ((in >> std::ws).peek() == 'P') {
+            std::string physics;
+            in >> magic >> physics >> replay.fixedPoint;
+            replay.physicsKind = ::getPhysicsKind(physics);
+        }
+        int playerCount;
+        in >> playerCount;
+        int frames;
+        while (in >> frames) {
+            Segment segment{frames, std::vector<std::string>(playerCount)};
+            std::string hash;
+            std::getline(in, hash);
+            if (hash.find_first_not_of(" \r") != std::string::npos) {
+                segment.hash = std::stoull(hash, nullptr, 16);
+                replay.hashed = true;
+            }
+            for (auto &input : segment.inputs) {
+                std::getline(in, input);
+            }
+            replay.segments.push_back(std::move(segment));
+        }
+        return replay;
+    }
+
+  protected:
+    std::string level;
+    std::optional<PhysicsKind> physicsKind;
+    bool fixedPoint = false;
+    std::vector<Segment> segments;
+    bool hashed = false;
+};
+
+// Looks up the inputs of any frame of a replay file mapped into memory,
+// only parsing the segment that holds it. The index at the end of the file
+// is binary searched where it lies. Replays saved without one are scanned
+// once to build the same entries.
+class ReplayIndex {
+  public:
+    // The data must stay mapped for as long as the index is used.
+    ReplayIndex(const char *data, size_t size) : data(data), size(size) {
+        const char *p = data;
+        if (!startsWith(p, "Replay ")) {
+            throw std::runtime_error("Invalid replay file");
+        }
+        p += 7;
+        const char *end = nextLine(p);
+        level.assign(p, end - p - 1);
+        if (!level.empty() && level.back() == '\r') {
+            level.pop_back();
+        }
+        p = end;
+        if (startsWith(p, "Physics ")) {
+            p += 8;
+            const char *name = p;
+            while (p < data + size && *p != ' ' && *p != '\n') {
+                p++;
+            }
+            physicsKind = ::getPhysicsKind(std::string(name, p));
+            fixedPoint = atoi(p) != 0;
+            p = nextLine(p);
+        }
+        playerCount = atoi(p);
+        p = nextLine(p);
+        inputs.resize(playerCount);
+
+        if (!findIndex()) {
+            buildIndex(p);
+        }
+    }
+
+    const std::string &getLevel() { return level; }
+    std::optional<PhysicsKind> getPhysicsKind() { return physicsKind; }
+    bool isFixedPoint() { return fixedPoint; }
+    int getPlayerCount() { return playerCount; }
+    int getFrameCount() { return frameCount; }
+
+    // The inputs of the frame with the given number, counted from 0.
+    const std::vector<std::string> &getInputs(int frame) {
+        if (frame < segmentBegin || frame >= segmentEnd) {
+            loadSegment(frame);
+        }
+        return inputs;
+    }
+
+  protected:
+    const char *data;
+    size_t size;
+    std::string level;
+    std::optional<PhysicsKind> physicsKind;
+    bool fixedPoint = false;
+    int playerCount = 0;
+    int frameCount = 0;
+
+    // The index entries, in the mapped file or in built.
+    const char *entries = nullptr;
+    int entryCount = 0;
+    std::string built;
+
+    // The segment that inputs were parsed from.
+    int segmentBegin = 0, segmentEnd = 0;
+    std::vector<std::string> inputs;
+
+    bool startsWith(const char *p, const char *prefix) {
+        size_t n = strlen(prefix);
+        return p + n <= data + size && memcmp(p, prefix, n) == 0;
+    }
+    const char *nextLine(const char *p) {
+        auto end = static_cast<const char *>(
+            memchr(p, '\n', data + size - p));
+        return end == nullptr ? data + size : end + 1;
+    }
+
+    int getEntryFrame(int i) {
+        return atoi(entries + i * Replay::INDEX_ENTRY_SIZE);
+    }
+    long long getEntryOffset(int i) {
+        return atoll(entries + i * Replay::INDEX_ENTRY_SIZE + 11);
+    }
+
+    bool findIndex() {
+        if (size < Replay::INDEX_FOOTER_SIZE || data[size - 1] != '\n') {
+            return false;
+        }
+        const char *footer = data + size - Replay::INDEX_FOOTER_SIZE;
+        for (int i = 0; i < Replay::INDEX_FOOTER_SIZE - 1; i++) {
+            if (footer[i] < '0' || footer[i] > '9') {
+                return false;
+            }
+        }
+        long long offset = atoll(footer);
+        if (offset < 0 || offset >= (long long)size ||
+            !startsWith(data + offset, "Index ")) {
+            return false;
+        }
+        const char *p = data + offset + 6;
+        entryCount = strtol(p, const_cast<char **>(&p), 10);
+        frameCount = strtol(p, nullptr, 10);
+        entries = nextLine(p);
+        if (entries + (size_t)entryCount * Replay::INDEX_ENTRY_SIZE >
+            footer) {
+            throw std::runtime_error("Corrupt replay index");
+        }
+        return true;
+    }
+
+    void buildIndex(const char *p) {
+        char entry[Replay::INDEX_ENTRY_SIZE + 1];
+        while (p < data + size && *p >= '0' && *p <= '9') {
+            snprintf(entry, sizeof(entry), "%010d %020lld\n", frameCount,
+                     (long long)(p - data));
+            built += entry;
+            entryCount++;
+            frameCount += atoi(p);
+            p = nextLine(p);
+            for (int i = 0; i < playerCount; i++) {
+                p = nextLine(p);
+            }
+        }
+        entries = built.data();
+    }
+
+    void loadSegment(int frame) {
+        if (frame < 0 || frame >= frameCount) {
+            throw std::runtime_error("Frame " + std::to_string(frame) +
+                                     " is not in the replay");
+        }
+        // The last entry that starts at or before the frame.
+        int lo = 0, hi = entryCount - 1;
+        while (lo < hi) {
+            int mid = (lo + hi + 1) / 2;
+            if (getEntryFrame(mid) <= frame) {
+                lo = mid;
+            } else {
+                hi = mid - 1;
+            }
+        }
+        const char *p = data + getEntryOffset(lo);
+        segmentBegin = getEntryFrame(lo);
+        segmentEnd = segmentBegin + atoi(p);
+        p = nextLine(p);
+        for (auto &input : inputs) {
+            const char *end = nextLine(p);
+            input.assign(p, end - p);
+            while (!input.empty() &&
+                   (input.back() == '\n' || input.back() == '\r')) {
+                input.pop_back();
+            }
+            p = end;
+        }
+    }
+};
+
+// Take over the physics a replay was recorded with, where it says. Options
+// that were given explicitly must agree with it, since a replay played with
+// other physics silently goes another way.
+template <typename R>
+void useReplayPhysics(R &replay, PhysicsKind &physicsKind, bool physicsGiven,
+                      bool &fixedPoint, bool fixedPointGiven) {
+    auto recorded = replay.getPhysicsKind();
+    if (!recorded.has_value()) {
+        return;
+    }
+    if (physicsGiven && physicsKind != *recorded) {
+        throw std::runtime_error("The replay was recorded with -P " +
+                                 getPhysicsName(*recorded) + ", not " +
+                                 getPhysicsName(physicsKind));
+    }
+    if (fixedPointGiven && fixedPoint != replay.isFixedPoint()) {
+        throw std::runtime_error("The replay was recorded without -x");
+    }
+    physicsKind = *recorded;
+    fixedPoint = replay.isFixedPoint();
+}
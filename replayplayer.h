@@ -0,0 +1,110 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gamemanager.h"
+#include "gamestate.h"
+#include "replay.h"
+
+// Plays a replay on a game and seeks to any frame of it. If the game can be
+// restored exactly, the state is kept every KEYFRAME_INTERVAL frames, so a
+// seek loads the keyframe before the target and only simulates the frames
+// after it. Keyframes are taken on the way when playing, and
+// buildKeyframes fills in the rest whenever the caller has time. Otherwise,
+// a seek back resets the game and simulates from the start.
+class ReplayPlayer {
+  public:
+    static constexpr int KEYFRAME_INTERVAL = 5 * FPS;
+
+    using Simulate = std::function<void(const std::vector<std::string> &)>;
+
+    // The game must have the level of the replay loaded, and simulate
+    // applies the inputs of a frame and steps the game.
+    ReplayPlayer(GameManager *gameManager, ReplayIndex *index,
+                 Simulate simulate)
+        : gameManager(gameManager), index(index), simulate(simulate) {
+        if (gameManager->canRestore()) {
+            keyframes.push_back(std::make_unique<GameState>());
+            gameManager->saveState(*keyframes.back());
+        }
+    }
+
+    // The number of frames played so far.
+    int getFrame() { return frame; }
+    int getFrameCount() { return index->getFrameCount(); }
+    bool isFinished() { return frame >= getFrameCount(); }
+
+    void step() {
+        if (isFinished()) {
+            return;
+        }
+        simulate(index->getInputs(frame));
+        frame++;
+        if (!keyframes.empty() && frame % KEYFRAME_INTERVAL == 0 &&
+            frame / KEYFRAME_INTERVAL == int(keyframes.size())) {
+            keyframes.push_back(std::make_unique<GameState>());
+            gameManager->saveState(*keyframes.back());
+        }
+    }
+
+    // Whether every keyframe of the replay has been taken.
+    bool hasAllKeyframes() {
+        return keyframes.empty() ||
+               int(keyframes.size()) > getFrameCount() / KEYFRAME_INTERVAL;
+    }
+
+    // Simulate up to the given number of frames past the furthest keyframe
+    // to take the next ones, and go back to where the game was. The events
+    // of those frames are dropped.
+    void buildKeyframes(int frames) {
+        if (hasAllKeyframes()) {
+            return;
+        }
+        gameManager->saveState(current);
+        int currentFrame = frame;
+        gameManager->holdEvents(true);
+        gameManager->loadState(*keyframes.back());
+        frame = (keyframes.size() - 1) * KEYFRAME_INTERVAL;
+        for (int i = 0; i < frames && !hasAllKeyframes(); i++) {
+            step();
+        }
+        gameManager->loadState(current);
+        gameManager->holdEvents(false);
+        frame = currentFrame;
+    }
+
+    void seek(int target) {
+        target = std::clamp(target, 0, getFrameCount());
+        if (!keyframes.empty()) {
+            int keyframe = std::min<int>(target / KEYFRAME_INTERVAL,
+                                         keyframes.size() - 1);
+            // Going on from the current frame is cheaper if it lies between
+            // the keyframe and the target.
+            if (target < frame || keyframe * KEYFRAME_INTERVAL > frame) {
+                gameManager->loadState(*keyframes[keyframe]);
+                frame = keyframe * KEYFRAME_INTERVAL;
+            }
+        } else if (target < frame) {
+            gameManager->reset();
+            frame = 0;
+        }
+        while (frame < target) {
+            step();
+        }
+    }
+
+  protected:
+    GameManager *gameManager;
+    ReplayIndex *index;
+    Simulate simulate;
+    int frame = 0;
+    // keyframes[i] is the state after i * KEYFRAME_INTERVAL frames. Empty if
+    // the game cannot be restored.
+    std::vector<std::unique_ptr<GameState>> keyframes;
+    // Where the game was while keyframes are built.
+    GameState current;
+};
@@ -0,0 +1,225 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+// Reads the resource usage of a running agent process from /proc. Only
+// Linux is supported; elsewhere every value stays zero.
+class ResourceMonitor {
+  public:
+    ResourceMonitor() {}
+
+    void setPid(int pid) {
+        this->pid = pid;
+#ifdef __linux__
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/%d/task/%d/children", pid, pid);
+        hasChildrenFiles = access(path, R_OK) == 0;
+#endif
+    }
+
+    // CPU time consumed so far by the agent: all threads of the process
+    // and of its descendants, including the threads and the children that
+    // already ended, so that work moved to a worker thread or a child
+    // process counts as well. The last known value is returned once the
+    // process is gone.
+    std::chrono::microseconds getCpuTime() {
+#ifdef __linux__
+        findProcesses();
+        unsigned long long ns = 0;
+        bool found = false;
+        for (int process : processes) {
+            // The clock of a process has nanosecond resolution and keeps
+            // the time of its ended threads.
+            clockid_t clock;
+            timespec time;
+            if (clock_getcpuclockid(process, &clock) != 0 ||
+                clock_gettime(clock, &time) != 0) {
+                continue;
+            }
+            found = true;
+            ns += time.tv_sec * 1000000000ull + time.tv_nsec;
+            // Children that were waited for are only left in clock ticks.
+            ns += readStat(process).childTicks * (1000000000ull / ticks);
+        }
+        if (found) {
+            // A child moving from its own clock to the ticks of its parent
+            // may lose a fraction of a tick.
+            cpuTime = std::max(cpuTime,
+                               std::chrono::microseconds(ns / 1000));
+        }
+#endif
+        return cpuTime;
+    }
+
+    // Peak resident set size of the process in kB.
+    long getPeakRss() {
+#ifdef __linux__
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/%d/status", pid);
+        FILE *f = fopen(path, "r");
+        if (f != nullptr) {
+            char line[256];
+            while (fgets(line, sizeof(line), f) != nullptr) {
+                if (strncmp(line, "VmHWM:", 6) == 0) {
+                    peakRss = atol(line + 6);
+                    break;
+                }
+            }
+            fclose(f);
+        }
+#endif
+        return peakRss;
+    }
+
+  private:
+    int pid = 0;
+    std::chrono::microseconds cpuTime{0};
+    long peakRss = 0;
+
+#ifdef __linux__
+    // Without the children files of the kernel, the descendants are found
+    // by scanning all of /proc, which is too slow for every frame.
+    static constexpr auto RESCAN_INTERVAL = std::chrono::milliseconds(250);
+
+    long ticks = sysconf(_SC_CLK_TCK);
+    bool hasChildrenFiles = false;
+    // The agent and its descendants.
+    std::vector<int> processes;
+    std::vector<std::pair<int, int>> parents;
+    std::chrono::steady_clock::time_point lastScan;
+
+    void findProcesses() {
+        if (hasChildrenFiles) {
+            processes.assign(1, pid);
+            for (int i = 0; i < processes.size(); i++) {
+                addChildren(processes[i]);
+            }
+            return;
+        }
+        auto now = std::chrono::steady_clock::now();
+        if (!processes.empty() && now - lastScan < RESCAN_INTERVAL) {
+            return;
+        }
+        lastScan = now;
+        // Every process with its parent, then the tree below the agent.
+        parents.clear();
+        DIR *dir = opendir("/proc");
+        if (dir == nullptr) {
+            return;
+        }
+        while (auto entry = readdir(dir)) {
+            int process = atoi(entry->d_name);
+            int parent = process > 0 ? readStat(process).parent : 0;
+            if (parent > 0) {
+                parents.emplace_back(parent, process);
+            }
+        }
+        closedir(dir);
+        std::sort(parents.begin(), parents.end());
+        processes.assign(1, pid);
+        for (int i = 0; i < processes.size(); i++) {
+            auto it = std::lower_bound(parents.begin(), parents.end(),
+                                       std::make_pair(processes[i], 0));
+            for (; it != parents.end() && it->first == processes[i]; it++) {
+                processes.push_back(it->second);
+            }
+        }
+    }
+
+    void addChildren(int process) {
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/%d/task", process);
+        DIR *dir = opendir(path);
+        if (dir == nullptr) {
+            return;
+        }
+        while (auto entry = readdir(dir)) {
+            int tid = atoi(entry->d_name);
+            if (tid <= 0) {
+                continue;
+            }
+            snprintf(path, sizeof(path), "/proc/%d/task/%d/children",
+                     process, tid);
+            if (FILE *f = fopen(path, "r")) {
+                int child;
+                while (fscanf(f, "%d", &child) == 1) {
+                    processes.push_back(child);
+                }
+                fclose(f);
+            }
+        }
+        closedir(dir);
+    }
+
+    struct Stat {
+        int parent = 0;
+        // cutime + cstime.
+        unsigned long long childTicks = 0;
+    };
+
+    static Stat readStat(int process) {
+        Stat stat;
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/%d/stat", process);
+        FILE *f = fopen(path, "r");
+        if (f == nullptr) {
+            return stat;
+        }
+        char line[1024];
+        size_t n = fread(line, 1, sizeof(line) - 1, f);
+        fclose(f);
+        line[n] = '\0';
+        // The name in parentheses may contain anything, so start after the
+        // last parenthesis, at the state.
+        char *p = strrchr(line, ')');
+        unsigned long long cutime, cstime;
+        if (p != nullptr &&
+            sscanf(p + 1,
+                   " %*c %d %*d %*d %*d %*d %*u %*u %*u %*u %*u %*u %*u "
+                   "%llu %llu",
+                   &stat.parent, &cutime, &cstime) == 3) {
+            stat.childTicks = cutime + cstime;
+        }
+        return stat;
+    }
+#endif
+};
+
+struct ResourceLimits {
+    // Address space limit in MB, unlimited when 0.
+    long memory = 0;
+    // Total CPU time limit in seconds, unlimited when 0.
+    long cpu = 0;
+
+    bool isEmpty() const { return memory == 0 && cpu == 0; }
+
+    // Called in the forked child right before exec.
+    void apply() const {
+#ifdef __linux__
+        if (memory > 0) {
+            rlimit limit;
+            limit.rlim_cur = limit.rlim_max = (rlim_t)memory * 1024 * 1024;
+            setrlimit(RLIMIT_AS, &limit);
+        }
+        if (cpu > 0) {
+            rlimit limit;
+            limit.rlim_cur = cpu;
+            limit.rlim_max = cpu + 1;
+            setrlimit(RLIMIT_CPU, &limit);
+        }
+#endif
+    }
+};
@@ -1,42 +1,213 @@
+#include <thread>
+
+#include "affinity.h"
+#include "botcontroller.h"
 #include "controller.h"
+#include "framescheduler.h"
 #include "gamemanager.h"
+#include "inputs.h"
 #include "mygetopt.h"
+#include "replay.h"
 
-std::pair<int, int> parseDirection(std::string direction) {
-    int x = 0;
-    int y = 0;
-    for (auto c : direction) {
-        switch (c) {
-        case 'L':
-            x -= 1;
-            break;
-        case 'R':
-            x += 1;
-            break;
-        case 'U':
-            y -= 1;
-            break;
-        case 'D':
-            y += 1;
-            break;
+// Whether the inputs leave every player alone for the frame.
+bool isIdle(const std::vector<std::string> &inputs) {
+    for (auto &input : inputs) {
+        if (!input.starts_with("Move") ||
+            parseDirection(input.substr(4)) != std::make_pair(0, 0)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The hash of the current state, checked against a full recompute if asked.
+uint64_t getStateHash(GameManager *gameManager, bool verify) {
+    auto hash = gameManager->getStateHash();
+    if (verify && hash != gameManager->computeStateHash()) {
+        throw std::runtime_error(
+            "State hash mismatch at frame " +
+            std::to_string(gameManager->orderManager.getFrame()));
+    }
+    return hash;
+}
+
+void runReplay(GameManager *gameManager, Replay &replay, bool fastForward,
+               bool verify) {
+    int frames = 0;
+    int skipped = 0;
+    int divergence = -1;
+    for (auto &segment : replay.getSegments()) {
+        bool idle = fastForward && isIdle(segment.inputs);
+        int remaining = segment.frames;
+        while (remaining > 0) {
+            int n = idle ? gameManager->fastForward(remaining) : 0;
+            if (n == 0) {
+                applyInputs(gameManager, segment.inputs);
+                gameManager->step();
+                n = 1;
+            } else {
+                skipped += n;
+            }
+            remaining -= n;
+            frames += n;
+            if (verify) {
+                getStateHash(gameManager, verify);
+            }
+        }
+        if (replay.hasHashes() && divergence < 0 &&
+            getStateHash(gameManager, verify) != segment.hash) {
+            divergence = frames;
+        }
+    }
+    printf("%d\n", gameManager->orderManager.getFund());
+    if (fastForward) {
+        fprintf(stderr, "Fast-forwarded %d / %d frames\n", skipped, frames);
+    }
+    if (divergence >= 0) {
+        fprintf(stderr, "State differs from the recording by frame %d\n",
+                divergence);
+    }
+}
+
+// The state hash after the first frames of a replay, simulated from the
+// start.
+uint64_t getReplayHash(Replay &replay, int frames, PhysicsKind physicsKind,
+                       bool fixedPoint) {
+    auto gameManager = std::make_unique<GameManager>();
+    gameManager->setPhysicsKind(physicsKind);
+    gameManager->setFixedPoint(fixedPoint);
+    gameManager->loadLevel(replay.getLevel());
+    for (auto &segment : replay.getSegments()) {
+        for (int i = 0; i < segment.frames && frames > 0; i++, frames--) {
+            applyInputs(gameManager.get(), segment.inputs);
+            gameManager->step();
+        }
+    }
+    return gameManager->getStateHash();
+}
+
+// Bisect for the number of frames after which the states of two replays
+// first differ, or -1 if they do not. Once the states differ, they are
+// assumed to stay different.
+int findDivergence(Replay &a, Replay &b, PhysicsKind physicsKind,
+                   bool fixedPoint) {
+    auto differ = [&](int frames) {
+        fprintf(stderr, "Comparing after %d frames\n", frames);
+        return getReplayHash(a, frames, physicsKind, fixedPoint) !=
+               getReplayHash(b, frames, physicsKind, fixedPoint);
+    };
+    int low = 0;
+    int high = std::min(a.getFrameCount(), b.getFrameCount());
+    if (!differ(high)) {
+        return -1;
+    }
+    if (differ(low)) {
+        return low;
+    }
+    while (high - low > 1) {
+        int mid = low + (high - low) / 2;
+        if (differ(mid)) {
+            high = mid;
+        } else {
+            low = mid;
         }
     }
-    if (x < -1)
-        x = -1;
-    if (x > 1)
-        x = 1;
-    if (y < -1)
-        y = -1;
-    if (y > 1)
-        y = 1;
-    return {x, y};
+    return high;
 }
 
+// Counts the game events for the report at the end.
+class EventTally : public IEventListener<DishServedEvent>,
+                   public IEventListener<CollisionEvent>,
+                   public IEventListener<PlayerFellEvent>,
+                   public IEventListener<OrderExpiredEvent>,
+                   public IEventListener<OvercookedEvent>,
+                   public IEventListener<PlateWashedEvent> {
+  public:
+    void subscribe(GameEventBus &events) {
+        events.subscribe<DishServedEvent>(this);
+        events.subscribe<CollisionEvent>(this);
+        events.subscribe<PlayerFellEvent>(this);
+        events.subscribe<OrderExpiredEvent>(this);
+        events.subscribe<OvercookedEvent>(this);
+        events.subscribe<PlateWashedEvent>(this);
+    }
+
+    void onEvents(int frame, const std::vector<DishServedEvent> &e) override {
+        for (auto &dish : e) {
+            (dish.price > 0 ? dishesServed : wrongDishes)++;
+        }
+    }
+    void onEvents(int frame, const std::vector<CollisionEvent> &e) override {
+        collisions += e.size();
+    }
+    void onEvents(int frame, const std::vector<PlayerFellEvent> &e) override {
+        falls += e.size();
+    }
+    void onEvents(int frame,
+                  const std::vector<OrderExpiredEvent> &e) override {
+        ordersExpired += e.size();
+    }
+    void onEvents(int frame, const std::vector<OvercookedEvent> &e) override {
+        overcooked += e.size();
+    }
+    void onEvents(int frame, const std::vector<PlateWashedEvent> &e) override {
+        platesWashed += e.size();
+    }
+
+    void print(FILE *out) {
+        fprintf(out,
+                "Events: %d dishes served, %d wrong dishes, %d orders "
+                "expired, %d overcooked, %d plates washed, %d falls, %d "
+                "collisions\n",
+                dishesServed, wrongDishes, ordersExpired, overcooked,
+                platesWashed, falls, collisions);
+    }
+
+  protected:
+    int dishesServed = 0;
+    int wrongDishes = 0;
+    int collisions = 0;
+    int falls = 0;
+    int ordersExpired = 0;
+    int overcooked = 0;
+    int platesWashed = 0;
+};
+
+const char *USAGE =
+    "Usage: runner [-l <level>] [-p <agent>] [-n <agent seats>] [-r]\n"
+    "              [-b <time bank ms>] [-s] [-u] [-m <memory MB>]\n"
+    "              [-t <CPU seconds>] [-a <simulator>,<agent> | auto:<game>]\n"
+    "              [-P box2d|grid|validate] [-x] [-o <replay>] [-H | -V]\n"
+    "       runner -R <replay> [-f] [-H | -V]\n"
+    "       runner -R <replay> -D <replay>\n"
+    "-s steps the next frame while the agent thinks and rolls it back if\n"
+    "the agent decides otherwise. Only the grid physics can be rolled back\n"
+    "exactly, so -s selects -P grid and refuses the others.\n";
+
 int main(int argc, char *argv[]) {
     const char *levelFile = "level1.txt";
     const char *program = "a.out";
+    TimingMode timingMode = TimingMode::Lockstep;
+    int timeBank = -1;
+    bool speculative = false;
+    bool cpuTimeout = false;
+    ResourceLimits limits;
+    const char *placement = nullptr;
+    PhysicsKind physicsKind = PhysicsKind::Box2D;
+    bool fixedPoint = false;
+    // Whether -P and -x were given, which replays must then agree with.
+    bool physicsGiven = false;
+    bool fixedPointGiven = false;
+    const char *recordFile = nullptr;
+    const char *replayFile = nullptr;
+    bool fastForward = false;
+    bool hashStates = false;
+    bool verifyHashes = false;
+    const char *compareFile = nullptr;
+    // The seats of the agent, all by default. The bot plays the others.
+    int agentSeats = -1;
     int o;
-    while ((o = getopt(argc, argv, "l:p:")) != -1) {
+    while ((o = getopt(argc, argv, "l:p:rb:sum:t:a:P:xo:R:fHVD:n:")) != -1) {
         switch (o) {
         case 'l':
             levelFile = optarg;
@@ -44,47 +215,260 @@ int main(int argc, char *argv[]) {
         case 'p':
             program = optarg;
             break;
+        case 'r':
+            timingMode = TimingMode::Realtime;
+            break;
+        case 'b':
+            timeBank = atoi(optarg);
+            break;
+        case 's':
+            speculative = true;
+            break;
+        case 'u':
+            cpuTimeout = true;
+            break;
+        case 'm':
+            limits.memory = atol(optarg);
+            break;
+        case 't':
+            limits.cpu = atol(optarg);
+            break;
+        case 'a':
+            placement = optarg;
+            break;
+        case 'P':
+            physicsKind = getPhysicsKind(optarg);
+            physicsGiven = true;
+            break;
+        case 'x':
+            fixedPoint = true;
+            fixedPointGiven = true;
+            break;
+        case 'o':
+            recordFile = optarg;
+            break;
+        case 'R':
+            replayFile = optarg;
+            break;
+        case 'f':
+            fastForward = true;
+            break;
+        case 'H':
+            hashStates = true;
+            break;
+        case 'V':
+            hashStates = true;
+            verifyHashes = true;
+            break;
+        case 'D':
+            compareFile = optarg;
+            break;
+        case 'n':
+            agentSeats = atoi(optarg);
+            break;
         default:
             printf("Unknown commandline argument %c\n", o);
+            fprintf(stderr, "%s", USAGE);
             break;
         }
     }
+    if (speculative) {
+        if (!physicsGiven) {
+            physicsKind = PhysicsKind::Grid;
+        } else if (physicsKind != PhysicsKind::Grid) {
+            fprintf(stderr, "-s needs -P grid, the only physics that can be "
+                            "rolled back exactly\n");
+            return 1;
+        }
+    }
+
+    // Pin the simulator before loading the level, so that its memory is
+    // allocated on the local NUMA node.
+    CorePair cores;
+    if (placement != nullptr) {
+        cores = parseCorePair(placement);
+        // Checked before pinning, which narrows the allowed set to one CPU.
+        if (!isCpuAllowed(cores.agent)) {
+            fprintf(stderr, "Warning: CPU %d is not available for the agent\n",
+                    cores.agent);
+        }
+        if (!pinCurrentThread(cores.simulator)) {
+            fprintf(stderr, "Warning: failed to pin to CPU %d\n",
+                    cores.simulator);
+        }
+        fprintf(stderr, "Simulator on CPU %d, agent on CPU %d\n",
+                cores.simulator, cores.agent);
+    }
+
+    if (replayFile != nullptr && compareFile != nullptr) {
+        auto a = Replay::load(replayFile);
+        auto b = Replay::load(compareFile);
+        useReplayPhysics(a, physicsKind, physicsGiven, fixedPoint,
+                         fixedPointGiven);
+        bool recorded = a.getPhysicsKind().has_value();
+        useReplayPhysics(b, physicsKind, physicsGiven || recorded,
+                         fixedPoint, fixedPointGiven || recorded);
+        int frame = findDivergence(a, b, physicsKind, fixedPoint);
+        if (frame < 0) {
+            printf("Replays match\n");
+        } else {
+            printf("Replays diverge at frame %d\n", frame);
+        }
+        return 0;
+    }
+
+    Replay replay;
+    if (replayFile != nullptr) {
+        replay = Replay::load(replayFile);
+        useReplayPhysics(replay, physicsKind, physicsGiven, fixedPoint,
+                         fixedPointGiven);
+    }
 
     auto gameManager = new GameManager();
+    gameManager->setPhysicsKind(physicsKind);
+    gameManager->setFixedPoint(fixedPoint);
+    EventTally tally;
+    tally.subscribe(gameManager->events);
+
+    // A replay runs without an agent.
+    if (replayFile != nullptr) {
+        gameManager->loadLevel(replay.getLevel());
+        runReplay(gameManager, replay, fastForward, verifyHashes);
+        tally.print(stderr);
+        gameManager->printReport(std::cerr);
+        if (hashStates) {
+            fprintf(stderr, "State hash: %016llx\n",
+                    (unsigned long long)gameManager->getStateHash());
+        }
+        delete gameManager;
+        return 0;
+    }
+
     gameManager->loadLevel(levelFile);
+    int playerCount = gameManager->getPlayers().size();
+    if (agentSeats < 0 || agentSeats > playerCount) {
+        agentSeats = playerCount;
+    }
+
+    // Without seats for the agent, no process is started at all.
+    CliController *controller = nullptr;
+    if (agentSeats > 0) {
+        // The agent process and the reader threads of tiny-process-library
+        // inherit the affinity of the thread that creates them.
+        if (placement != nullptr) {
+            pinCurrentThread(cores.agent);
+        }
+        controller = new CliController(gameManager, program, limits);
+        if (placement != nullptr) {
+            pinCurrentThread(cores.simulator);
+        }
+        controller->setTimingMode(timingMode);
+        controller->setCpuTimeout(cpuTimeout);
+        if (timeBank >= 0) {
+            controller->setTimeBank(std::chrono::milliseconds(timeBank));
+        }
+        controller->init(levelFile);
+    }
+    BotController *bot = nullptr;
+    if (agentSeats < playerCount) {
+        bot = new BotController(gameManager, agentSeats);
+        bot->init(levelFile);
+    }
+    // The inputs of the agent for its seats and of the bot for the rest.
+    auto receiveInputs = [&]() {
+        std::vector<std::string> inputs(playerCount, "Move");
+        if (controller != nullptr) {
+            inputs = controller->receiveInputs();
+        }
+        if (bot != nullptr) {
+            bot->fillInputs(inputs);
+        }
+        return inputs;
+    };
 
-    auto controller = new CliController(gameManager, program);
-    controller->init(levelFile);
+    GameState savedState;
+    std::vector<std::string> lastInputs;
+    replay = Replay(levelFile, physicsKind, fixedPoint);
+    int speculationHits = 0;
 
+    FrameScheduler scheduler;
     int frame = gameManager->orderManager.getTimeCountdown();
     for (int i = 0; i < frame; i++) {
-        auto inputs = controller->requestInputs();
-        assert(inputs.size() == gameManager->getPlayers().size());
-        for (int i = 0; i < inputs.size(); i++) {
-            auto &input = inputs[i];
-            auto &player = gameManager->getPlayers()[i];
-            if (input.starts_with("Move")) {
-                auto direction = input.substr(4);
-                auto [x, y] = parseDirection(direction);
-                gameManager->move(i, b2Vec2(x, y));
-            } else if (input.starts_with("Interact")) {
-                auto direction = input.substr(8);
-                auto [x, y] = parseDirection(direction);
-                x += player->getBody()->GetPosition().x;
-                y += player->getBody()->GetPosition().y;
-                gameManager->interact(i, x, y);
-            } else if (input.starts_with("PutOrPick")) {
-                auto direction = input.substr(9);
-                auto [x, y] = parseDirection(direction);
-                x += player->getBody()->GetPosition().x;
-                y += player->getBody()->GetPosition().y;
-                gameManager->putOrPick(i, x, y);
+        if (timingMode == TimingMode::Realtime && i > 0) {
+            // The simulation keeps its own clock instead of waiting for the
+            // agent.
+            scheduler.wait();
+        }
+        if (controller != nullptr) {
+            controller->sendRequest();
+        }
+        // The bot decides while the agent is thinking.
+        if (bot != nullptr) {
+            bot->decide();
+        }
+        if (speculative && i > 0) {
+            // Step the next frame with the previous inputs while the agent is
+            // thinking, and roll back if it decided otherwise.
+            gameManager->saveState(savedState);
+            gameManager->holdEvents(true);
+            applyInputs(gameManager, lastInputs);
+            gameManager->step();
+            auto inputs = receiveInputs();
+            if (inputs == lastInputs) {
+                speculationHits++;
+            } else {
+                gameManager->loadState(savedState);
+                applyInputs(gameManager, inputs);
+                gameManager->step();
+                lastInputs = std::move(inputs);
+            }
+            gameManager->holdEvents(false);
+        } else {
+            auto inputs = receiveInputs();
+            applyInputs(gameManager, inputs);
+            gameManager->step();
+            lastInputs = std::move(inputs);
+        }
+        if (hashStates) {
+            auto hash = getStateHash(gameManager, verifyHashes);
+            if (recordFile != nullptr) {
+                replay.add(lastInputs, hash);
             }
+        } else if (recordFile != nullptr) {
+            replay.add(lastInputs);
+        }
+        if (i == 0) {
+            scheduler.start();
         }
-        gameManager->step();
+    }
+    if (timingMode == TimingMode::Realtime) {
+        fprintf(stderr, "Frame rate: %.2f / %d FPS\n",
+                scheduler.getAverageFps(), scheduler.getTargetFps());
+    }
+
+    if (recordFile != nullptr) {
+        replay.save(recordFile);
     }
 
     printf("%d\n", gameManager->orderManager.getFund());
+    if (controller != nullptr) {
+        controller->getReport().print(std::cerr);
+    }
+    if (bot != nullptr) {
+        bot->printReport(std::cerr);
+    }
+    tally.print(stderr);
+    gameManager->printReport(std::cerr);
+    if (hashStates) {
+        fprintf(stderr, "State hash: %016llx\n",
+                (unsigned long long)gameManager->getStateHash());
+    }
+    if (speculative) {
+        fprintf(stderr, "Speculation hits: %d / %d\n", speculationHits,
+                frame - 1);
+    }
 
+    delete bot;
     delete controller;
+    delete gameManager;
 }
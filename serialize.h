@@ -0,0 +1,22 @@
+#pragma once
+
+#include <charconv>
+#include <cstdio>
+#include <string>
+#include <type_traits>
+
+// Append numbers to a string the way an std::ostream with the default flags
+// prints them, without the allocations of a stringstream.
+template <typename T>
+    requires std::is_integral_v<T>
+void appendNumber(std::string &out, T value) {
+    char buffer[24];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    out.append(buffer, result.ptr);
+}
+
+inline void appendNumber(std::string &out, double value) {
+    char buffer[32];
+    int n = snprintf(buffer, sizeof(buffer), "%g", value);
+    out.append(buffer, n);
+}
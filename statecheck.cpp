@@ -0,0 +1,118 @@
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "botcontroller.h"
+#include "gamemanager.h"
+#include "inputs.h"
+
+// Checks that a restored game goes on exactly like one that never was. The
+// bot plays a level, then its inputs are played again on the game after a
+// reset, and, if the physics can be restored, on a new game the way the
+// runner speculates, except that every frame is first stepped with the
+// inputs of the frame before and rolled back. The state hashes and the
+// collisions reported must be the same in all of them.
+//
+// Usage: statecheck level [physics]
+
+class CollisionCounter : public IEventListener<CollisionEvent> {
+  public:
+    void onEvents(int frame, const std::vector<CollisionEvent> &e) override {
+        collisions += e.size();
+    }
+
+    int collisions = 0;
+};
+
+struct Game {
+    std::unique_ptr<GameManager> gameManager;
+    CollisionCounter counter;
+
+    Game(const char *levelFile, PhysicsKind physicsKind) {
+        gameManager = std::make_unique<GameManager>();
+        gameManager->setPhysicsKind(physicsKind);
+        gameManager->loadLevel(levelFile);
+        gameManager->events.subscribe<CollisionEvent>(&counter);
+    }
+
+    void step(const std::vector<std::string> &inputs) {
+        applyInputs(gameManager.get(), inputs);
+        gameManager->step();
+    }
+};
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s level [physics]\n", argv[0]);
+        return 2;
+    }
+    const char *levelFile = argv[1];
+    auto physicsKind =
+        getPhysicsKind(argc > 2 ? argv[2] : std::string("grid"));
+
+    Game lockstep(levelFile, physicsKind);
+    BotController bot(lockstep.gameManager.get());
+    bot.init(levelFile);
+    int frames = lockstep.gameManager->orderManager.getTimeCountdown();
+    std::vector<std::vector<std::string>> inputs;
+    std::vector<uint64_t> hashes;
+    for (int i = 0; i < frames; i++) {
+        inputs.push_back(bot.requestInputs());
+        lockstep.step(inputs.back());
+        hashes.push_back(lockstep.gameManager->computeStateHash());
+    }
+
+    int collisions = lockstep.counter.collisions;
+    auto physics = lockstep.gameManager->getPhysics();
+    lockstep.gameManager->reset();
+    if (lockstep.gameManager->canRestore() &&
+        lockstep.gameManager->getPhysics() != physics) {
+        printf("Reset built a new physics although it can be restored\n");
+        return 1;
+    }
+    lockstep.counter.collisions = 0;
+    for (int i = 0; i < frames; i++) {
+        lockstep.step(inputs[i]);
+        if (lockstep.gameManager->computeStateHash() != hashes[i]) {
+            printf("States differ after reset and frame %d\n", i + 1);
+            return 1;
+        }
+    }
+    if (lockstep.counter.collisions != collisions) {
+        printf("Collisions differ: %d, %d after reset\n", collisions,
+               lockstep.counter.collisions);
+        return 1;
+    }
+    if (!lockstep.gameManager->canRestore()) {
+        printf("States match over %d frames after reset, %d collisions; "
+               "the physics cannot be restored\n",
+               frames, collisions);
+        return 0;
+    }
+
+    Game speculative(levelFile, physicsKind);
+    GameState savedState;
+    for (int i = 0; i < frames; i++) {
+        if (i > 0) {
+            speculative.gameManager->saveState(savedState);
+            speculative.gameManager->holdEvents(true);
+            speculative.step(inputs[i - 1]);
+            speculative.gameManager->loadState(savedState);
+        }
+        speculative.step(inputs[i]);
+        speculative.gameManager->holdEvents(false);
+        if (speculative.gameManager->computeStateHash() != hashes[i]) {
+            printf("States differ after frame %d\n", i + 1);
+            return 1;
+        }
+    }
+    if (speculative.counter.collisions != collisions) {
+        printf("Collisions differ: %d in lockstep, %d speculating\n",
+               collisions, speculative.counter.collisions);
+        return 1;
+    }
+    printf("States match over %d frames, %d collisions\n", frames,
+           collisions);
+    return 0;
+}
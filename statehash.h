@@ -0,0 +1,65 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <string>
+
+#include <box2d/box2d.h>
+
+// Hashes values in sequence. The result only depends on the values, not on
+// addresses or the standard library, so hashes of different runs and
+// builds can be compared.
+class StateHasher {
+  public:
+    explicit StateHasher(uint64_t seed = 0) : value(seed) {}
+
+    uint64_t get() const { return value; }
+
+    StateHasher &add(uint64_t v) {
+        value = mix(value ^ v);
+        return *this;
+    }
+    StateHasher &add(int v) { return add(uint64_t(uint32_t(v))); }
+    StateHasher &add(bool v) { return add(uint64_t(v)); }
+    StateHasher &add(float v) {
+        return add(uint64_t(std::bit_cast<uint32_t>(v)));
+    }
+    StateHasher &add(b2Vec2 v) { return add(v.x).add(v.y); }
+    StateHasher &add(const std::string &s) {
+        // FNV-1a.
+        uint64_t h = 0xcbf29ce484222325ull;
+        for (unsigned char c : s) {
+            h = (h ^ c) * 0x100000001b3ull;
+        }
+        return add(h);
+    }
+
+    // The finalizer of SplitMix64.
+    static uint64_t mix(uint64_t x) {
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ull;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebull;
+        x ^= x >> 31;
+        return x;
+    }
+
+  protected:
+    uint64_t value;
+};
+
+enum class HashComponent {
+    Globals,
+    Tile,
+    Player,
+    Order,
+    Respawn,
+    Contacts,
+};
+
+// The state hash is the XOR of one such key per component, so replacing a
+// component only costs removing its old key and adding the new one.
+inline uint64_t componentHash(HashComponent kind, int index, uint64_t hash) {
+    uint64_t slot = (uint64_t(kind) << 32) | uint32_t(index);
+    return StateHasher::mix(hash + StateHasher::mix(slot + 1));
+}
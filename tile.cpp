@@ -1,8 +1,56 @@
 #include "tile.h"
 
+#include <limits>
+
 #include "gamemanager.h"
 #include "recipe.h"
 
+void StaticGeometry::build(const std::vector<Tile *> &map, int width,
+                           int height) {
+    this->width = width;
+    this->height = height;
+    rects.clear();
+    rectIndex.assign(width * height, -1);
+
+    auto isSolid = [&](int x, int y) {
+        auto tile = map[x + y * width];
+        return tile != nullptr && tile->isSolid();
+    };
+
+    // Greedily grow each rectangle to the right first, then downwards while
+    // the whole row below is solid and not yet covered.
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            if (rectIndex[x + y * width] >= 0 || !isSolid(x, y)) {
+                continue;
+            }
+            int w = 1;
+            while (x + w < width && rectIndex[x + w + y * width] < 0 &&
+                   isSolid(x + w, y)) {
+                w++;
+            }
+            int h = 1;
+            while (y + h < height) {
+                bool full = true;
+                for (int i = x; i < x + w && full; i++) {
+                    full = rectIndex[i + (y + h) * width] < 0 &&
+                           isSolid(i, y + h);
+                }
+                if (!full) {
+                    break;
+                }
+                h++;
+            }
+            for (int j = y; j < y + h; j++) {
+                for (int i = x; i < x + w; i++) {
+                    rectIndex[i + j * width] = rects.size();
+                }
+            }
+            rects.push_back(Rect{x, y, w, h});
+        }
+    }
+}
+
 bool TileChoppingStation::interact() {
     if (containerOnTable.isNull()) {
         return false;
@@ -25,32 +73,101 @@ bool TileChoppingStation::interact() {
     return true;
 }
 
-void TileStove::lateUpdate() {
-    if (containerOnTable.isNull()) {
+const Recipe *TileStove::findRecipe() {
+    for (auto &recipe : gameManager->getRecipes()) {
+        if (containerOnTable.matchRecipe(&recipe) &&
+            recipe.tileKind == tileKind) {
+            return &recipe;
+        }
+    }
+    if (!containerOnTable.isEmpty() &&
+        (containerOnTable.getContainerKind() == ContainerKind::Pan ||
+         containerOnTable.getContainerKind() == ContainerKind::Pot)) {
+        return &GeneralCookingRecipe;
+    }
+    return nullptr;
+}
+
+void TileStove::sync() {
+    int now = gameManager->getTimers()->getNow();
+    int frames = now - syncedFrame;
+    syncedFrame = now;
+    if (frames <= 0 || containerOnTable.isNull()) {
         return;
     }
 
     if (!containerOnTable.isWorking()) {
-        for (auto &recipe : gameManager->getRecipes()) {
-            if (containerOnTable.matchRecipe(&recipe) &&
-                recipe.tileKind == tileKind) {
-                containerOnTable.setRecipe(&recipe);
-                break;
-            }
+        auto recipe = findRecipe();
+        if (recipe == nullptr) {
+            return;
         }
+        containerOnTable.setRecipe(recipe);
     }
 
+    // The timer guarantees that only the last frame can do more than
+    // advancing the progress.
+    containerOnTable.advance(tileKind, frames - 1);
+    bool overcooked = containerOnTable.isOvercooked();
+    containerOnTable.step(tileKind);
+    if (!overcooked && containerOnTable.isOvercooked()) {
+        gameManager->events.publish(
+            OvercookedEvent{(int)position.x, (int)position.y});
+    }
+}
+
+void TileStove::scheduleEvent() {
+    generation++;
+    if (containerOnTable.isNull()) {
+        return;
+    }
+
+    int steps;
     if (!containerOnTable.isWorking()) {
-        if (!containerOnTable.isEmpty() &&
-            (containerOnTable.getContainerKind() == ContainerKind::Pan ||
-             containerOnTable.getContainerKind() == ContainerKind::Pot)) {
-            containerOnTable.setRecipe(&GeneralCookingRecipe);
-        } else {
+        if (findRecipe() == nullptr) {
+            return;
+        }
+        steps = 1;
+    } else {
+        steps = containerOnTable.getStepsUntilChange(tileKind);
+        if (steps == std::numeric_limits<int>::max()) {
             return;
         }
     }
+    auto timers = gameManager->getTimers();
+    timers->schedule(timers->getNow() + steps, this, generation);
+}
 
-    containerOnTable.step(tileKind);
+bool TileStove::put(ContainerHolder &container) {
+    sync();
+    bool res = TileTable::put(container);
+    scheduleEvent();
+    return res;
+}
+
+ContainerHolder TileStove::pick() {
+    sync();
+    auto container = TileTable::pick();
+    scheduleEvent();
+    return container;
+}
+
+ContainerHolder *TileStove::getContainer() {
+    sync();
+    return &containerOnTable;
+}
+
+void TileStove::loadContainer(ContainerHolder &container) {
+    containerOnTable.copyFrom(container);
+    syncedFrame = gameManager->getTimers()->getNow();
+    scheduleEvent();
+}
+
+void TileStove::onTimer(int tag) {
+    if (tag != generation) {
+        return;
+    }
+    sync();
+    scheduleEvent();
 }
 
 bool TileServiceWindow::put(ContainerHolder &container) {
@@ -62,6 +179,8 @@ bool TileServiceWindow::put(ContainerHolder &container) {
     int price = gameManager->orderManager.serveDish(dish);
     float factor = container.calcPriceFactor();
     gameManager->orderManager.addFund(price * factor);
+    gameManager->events.publish(
+        DishServedEvent{(int)position.x, (int)position.y, price, factor});
 
     Tile *plateReturn = nullptr;
     Tile *sink = nullptr;
@@ -115,6 +234,8 @@ bool TileSink::interact() {
             std::make_pair(rack->getPos().x, rack->getPos().y));
         gameManager->entityManager.scheduleRespawn(std::move(dish), 1);
         containerOnTable.removeOnePlate();
+        gameManager->events.publish(
+            PlateWashedEvent{(int)position.x, (int)position.y});
     }
     return true;
 }
@@ -1,22 +1,25 @@
 #pragma once
 
 #include <box2d/box2d.h>
+#include <memory>
 #include <optional>
+#include <vector>
 
 #include "foodcontainer.h"
 #include "interfaces.h"
 #include "mixture.h"
+#include "timerwheel.h"
 
 class GameManager;
 
 class Tile : public IBody {
   public:
     Tile() {}
+    virtual ~Tile() {}
 
     b2Vec2 getPos() { return position; }
     void setPos(b2Vec2 position) { this->position = position; }
 
-    virtual void initB2(b2World *world) {}
     void setGameManager(GameManager *gameManager) {
         this->gameManager = gameManager;
     }
@@ -25,8 +28,16 @@ class Tile : public IBody {
     virtual ContainerHolder pick() { return ContainerHolder(); }
     virtual bool interact() { return false; }
     virtual ContainerHolder *getContainer() { return nullptr; }
+    // Restore the container from a saved state.
+    virtual void loadContainer(ContainerHolder &container) {
+        getContainer()->copyFrom(container);
+    }
 
     TileKind getTileKind() const { return tileKind; }
+    // Whether players collide with the tile.
+    bool isSolid() const {
+        return tileKind != TileKind::Void && tileKind != TileKind::Floor;
+    }
 
   protected:
     b2Vec2 position{};
@@ -47,18 +58,37 @@ class TileFloor : public Tile {
 class TileWall : public Tile {
   public:
     TileWall() { tileKind = TileKind::Wall; }
+};
 
-    void initB2(b2World *world) override {
-        b2BodyDef bodyDef;
-        bodyDef.type = b2_staticBody;
-        bodyDef.position.Set(position.x + 0.5f, position.y + 0.5f);
-        body = world->CreateBody(&bodyDef);
-        b2PolygonShape shape;
-        shape.SetAsBox(0.5f, 0.5f);
-        body->CreateFixture(&shape, 0.0f);
+// The solid tiles of a level merged into as few rectangles as possible.
+// Physics backends collide with the rectangles instead of single tiles, so
+// there are fewer shapes and players no longer snag on the edges between
+// neighbouring tiles.
+class StaticGeometry : public IBody {
+  public:
+    struct Rect {
+        int x, y, w, h;
+    };
 
-        setUserData(BodyKind::Wall);
+    StaticGeometry() { bodyKind = BodyKind::Wall; }
+
+    void build(const std::vector<Tile *> &map, int width, int height);
+
+    const std::vector<Rect> &getRects() { return rects; }
+    // The index of the rectangle covering the tile, or -1 if it is not solid
+    // or outside of the map.
+    int getRectIndex(int x, int y) {
+        if (x < 0 || x >= width || y < 0 || y >= height) {
+            return -1;
+        }
+        return rectIndex[x + y * width];
     }
+
+  protected:
+    int width = 0;
+    int height = 0;
+    std::vector<Rect> rects;
+    std::vector<int> rectIndex;
 };
 
 class TileTable : public TileWall {
@@ -98,10 +128,9 @@ class TileIngredientBox : public TileTable {
     ContainerHolder pick() override {
         auto container = TileTable::pick();
         if (container.isNull()) {
-            container =
-                ContainerHolder(ContainerKind::None, Mixture(ingredient));
+            return ContainerHolder(ContainerKind::None, Mixture(ingredient));
         }
-        return std::move(container);
+        return container;
     }
 
   protected:
@@ -129,11 +158,30 @@ class TileChoppingStation : public TileTable {
     bool interact() override;
 };
 
-class TileStove : public TileTable, public IUpdatable {
+// Cooking advances once per frame, but the progress is only brought up to
+// date when the container is accessed or when a timer marks a frame in which
+// more than the progress changes.
+class TileStove : public TileTable, public ITimerListener {
   public:
     TileStove() { tileKind = TileKind::Stove; }
 
-    void lateUpdate() override;
+    bool put(ContainerHolder &container) override;
+    ContainerHolder pick() override;
+    ContainerHolder *getContainer() override;
+    void loadContainer(ContainerHolder &container) override;
+
+    void onTimer(int tag) override;
+
+  protected:
+    // The frame up to which the cooking has been applied.
+    int syncedFrame = 0;
+    // Tells the current timer from the stale ones.
+    int generation = 0;
+
+    // The recipe that a frame on the stove would start, if any.
+    const Recipe *findRecipe();
+    void sync();
+    void scheduleEvent();
 };
 
 class TileServiceWindow : public TileWall {
@@ -169,33 +217,96 @@ class TilePlateRack : public TileTable {
     TilePlateRack() { tileKind = TileKind::PlateRack; }
 };
 
-inline Tile *CreateTile(TileKind kind) {
-    switch (kind) {
-    case TileKind::Void:
-        return new TileVoid();
-    case TileKind::Floor:
-        return new TileFloor();
-    case TileKind::Wall:
-        return new TileWall();
-    case TileKind::Table:
-        return new TileTable();
-    case TileKind::Trashbin:
-        return new TileTrashbin();
-    case TileKind::ChoppingStation:
-        return new TileChoppingStation();
-    case TileKind::Stove:
-        return new TileStove();
-    case TileKind::ServiceWindow:
-        return new TileServiceWindow();
-    case TileKind::IngredientBox:
-        return new TileIngredientBox();
-    case TileKind::PlateReturn:
-        return new TilePlateReturn();
-    case TileKind::Sink:
-        return new TileSink();
-    case TileKind::PlateRack:
-        return new TilePlateRack();
-    default:
-        throw std::runtime_error("CreateTile: Unknown tile kind");
-    }
-}
+// Owns the tiles of a level in one dense array per kind, with the
+// containers of the tables inline, instead of one allocation per tile.
+// Every array is reserved from the kinds of the whole map before any tile
+// is created, so the pointers handed out stay valid.
+class TileStorage {
+  public:
+    TileStorage() {}
+    TileStorage(const TileStorage &) = delete;
+    TileStorage &operator=(const TileStorage &) = delete;
+
+    void reserve(const std::vector<TileKind> &kinds) {
+        int counts[KIND_COUNT] = {};
+        for (auto kind : kinds) {
+            counts[static_cast<int>(kind)]++;
+        }
+        prepare(voids, counts[static_cast<int>(TileKind::Void)]);
+        prepare(floors, counts[static_cast<int>(TileKind::Floor)]);
+        prepare(walls, counts[static_cast<int>(TileKind::Wall)]);
+        prepare(tables, counts[static_cast<int>(TileKind::Table)]);
+        prepare(trashbins, counts[static_cast<int>(TileKind::Trashbin)]);
+        prepare(choppingStations,
+                counts[static_cast<int>(TileKind::ChoppingStation)]);
+        prepare(stoves, counts[static_cast<int>(TileKind::Stove)]);
+        prepare(serviceWindows,
+                counts[static_cast<int>(TileKind::ServiceWindow)]);
+        prepare(ingredientBoxes,
+                counts[static_cast<int>(TileKind::IngredientBox)]);
+        prepare(plateReturns, counts[static_cast<int>(TileKind::PlateReturn)]);
+        prepare(sinks, counts[static_cast<int>(TileKind::Sink)]);
+        prepare(plateRacks, counts[static_cast<int>(TileKind::PlateRack)]);
+    }
+
+    Tile *create(TileKind kind) {
+        switch (kind) {
+        case TileKind::Void:
+            return add(voids);
+        case TileKind::Floor:
+            return add(floors);
+        case TileKind::Wall:
+            return add(walls);
+        case TileKind::Table:
+            return add(tables);
+        case TileKind::Trashbin:
+            return add(trashbins);
+        case TileKind::ChoppingStation:
+            return add(choppingStations);
+        case TileKind::Stove:
+            return add(stoves);
+        case TileKind::ServiceWindow:
+            return add(serviceWindows);
+        case TileKind::IngredientBox:
+            return add(ingredientBoxes);
+        case TileKind::PlateReturn:
+            return add(plateReturns);
+        case TileKind::Sink:
+            return add(sinks);
+        case TileKind::PlateRack:
+            return add(plateRacks);
+        default:
+            throw std::runtime_error("TileStorage: Unknown tile kind");
+        }
+    }
+
+  protected:
+    static constexpr int KIND_COUNT =
+        static_cast<int>(TileKind::PlateRack) + 1;
+
+    std::vector<TileVoid> voids;
+    std::vector<TileFloor> floors;
+    std::vector<TileWall> walls;
+    std::vector<TileTable> tables;
+    std::vector<TileTrashbin> trashbins;
+    std::vector<TileChoppingStation> choppingStations;
+    std::vector<TileStove> stoves;
+    std::vector<TileServiceWindow> serviceWindows;
+    std::vector<TileIngredientBox> ingredientBoxes;
+    std::vector<TilePlateReturn> plateReturns;
+    std::vector<TileSink> sinks;
+    std::vector<TilePlateRack> plateRacks;
+
+    template <typename T>
+    static void prepare(std::vector<T> &tiles, int count) {
+        tiles.clear();
+        tiles.reserve(count);
+    }
+
+    template <typename T> static Tile *add(std::vector<T> &tiles) {
+        if (tiles.size() == tiles.capacity()) {
+            throw std::runtime_error("TileStorage: Tile was not reserved");
+        }
+        return &tiles.emplace_back();
+    }
+};
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <vector>
+
+class ITimerListener {
+  public:
+    // Called once the frame of a deadline is reached. Timers cannot be
+    // cancelled, so listeners use the tag to ignore the ones that are stale.
+    virtual void onTimer(int tag) = 0;
+};
+
+// A hierarchical timer wheel keyed by absolute frame numbers. A timer sits
+// on the level of the highest 6-bit group in which its deadline differs
+// from the current frame, and moves down a level each time the current
+// frame reaches that group. Advancing a frame only looks at the timers that
+// fire or move down, however many are pending.
+class TimerWheel {
+  public:
+    TimerWheel() {}
+
+    int getNow() { return now; }
+
+    // Drop every timer and restart the wheel at the given frame.
+    void reset(int now) {
+        this->now = now;
+        for (auto &level : buckets) {
+            for (auto &slot : level) {
+                slot.clear();
+            }
+        }
+        overflow.clear();
+    }
+
+    void schedule(int deadline, ITimerListener *listener, int tag) {
+        assert(deadline > now);
+        insert(Timer{deadline, listener, tag});
+    }
+
+    // Move on to the next frame and fire the timers due in it. The order in
+    // which they fire only depends on when they were scheduled.
+    void advance() {
+        now++;
+        for (int level = LEVELS - 1; level > 0; level--) {
+            if ((now & ((1 << (level * SLOT_BITS)) - 1)) == 0) {
+                cascade(level);
+            }
+        }
+        if ((now & ((1 << (LEVELS * SLOT_BITS)) - 1)) == 0) {
+            auto timers = std::move(overflow);
+            overflow.clear();
+            for (auto &timer : timers) {
+                insert(timer);
+            }
+        }
+
+        auto &slot = buckets[0][now & SLOT_MASK];
+        if (slot.empty()) {
+            return;
+        }
+        firing.swap(slot);
+        for (auto &timer : firing) {
+            assert(timer.deadline == now);
+            timer.listener->onTimer(timer.tag);
+        }
+        firing.clear();
+    }
+
+    // The earliest pending deadline, or INT_MAX if there is none. Stale
+    // timers count as well.
+    int getNextDeadline() {
+        for (int level = 0; level < LEVELS; level++) {
+            int index = (now >> (level * SLOT_BITS)) & SLOT_MASK;
+            for (int i = index + 1; i < SLOTS; i++) {
+                auto &slot = buckets[level][i];
+                if (!slot.empty()) {
+                    return earliest(slot);
+                }
+            }
+        }
+        return earliest(overflow);
+    }
+
+  protected:
+    static constexpr int SLOT_BITS = 6;
+    static constexpr int SLOTS = 1 << SLOT_BITS;
+    static constexpr int SLOT_MASK = SLOTS - 1;
+    static constexpr int LEVELS = 4;
+
+    struct Timer {
+        int deadline;
+        ITimerListener *listener;
+        int tag;
+    };
+
+    int now = 0;
+    std::vector<Timer> buckets[LEVELS][SLOTS];
+    // Timers too far ahead for the top level.
+    std::vector<Timer> overflow;
+    std::vector<Timer> firing;
+
+    void insert(const Timer &timer) {
+        int diff = timer.deadline ^ now;
+        if (diff == 0) {
+            // Only while cascading into the frame that is about to fire.
+            buckets[0][now & SLOT_MASK].push_back(timer);
+            return;
+        }
+        for (int level = LEVELS - 1; level >= 0; level--) {
+            if ((diff >> (level * SLOT_BITS)) != 0) {
+                if ((diff >> ((level + 1) * SLOT_BITS)) != 0) {
+                    break;
+                }
+                int index = (timer.deadline >> (level * SLOT_BITS)) & SLOT_MASK;
+                buckets[level][index].push_back(timer);
+                return;
+            }
+        }
+        overflow.push_back(timer);
+    }
+
+    void cascade(int level) {
+        int index = (now >> (level * SLOT_BITS)) & SLOT_MASK;
+        auto timers = std::move(buckets[level][index]);
+        buckets[level][index].clear();
+        for (auto &timer : timers) {
+            insert(timer);
+        }
+    }
+
+    static int earliest(const std::vector<Timer> &timers) {
+        int deadline = std::numeric_limits<int>::max();
+        for (auto &timer : timers) {
+            deadline = std::min(deadline, timer.deadline);
+        }
+        return deadline;
+    }
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <atomic>
+
+// Hands the latest value from one writer thread to one reader thread
+// without locks. The writer fills the back slot and publishes it; the
+// reader picks up the most recent published slot, skipping the ones it
+// was too slow for. Neither side ever waits for the other.
+template <typename T> class TripleBuffer {
+  public:
+    TripleBuffer() {}
+    TripleBuffer(const TripleBuffer &) = delete;
+    TripleBuffer &operator=(const TripleBuffer &) = delete;
+
+    // Writer side.
+    T &getBack() { return buffers[back]; }
+    void publish() { back = middle.exchange(back | FRESH) & INDEX; }
+
+    // Reader side. Returns whether a newer value than the current front
+    // was published.
+    bool update() {
+        if ((middle.load() & FRESH) == 0) {
+            return false;
+        }
+        front = middle.exchange(front) & INDEX;
+        return true;
+    }
+    const T &getFront() { return buffers[front]; }
+
+  protected:
+    static constexpr int INDEX = 3;
+    static constexpr int FRESH = 4;
+
+    // Not called slots, which Qt defines as a macro.
+    T buffers[3];
+    int back = 0;
+    int front = 1;
+    // The slot between the two sides, with FRESH set if the reader has not
+    // taken it yet.
+    std::atomic<int> middle{2};
+};